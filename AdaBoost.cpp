@@ -28,9 +28,86 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "AdaBoost.h"
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 #include <cmath>
 #include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cfloat>
+#include <atomic>
+#include <random>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "readSampleDataFile.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "StumpKernels.h"
+#include "Profiler.h"
+#include "SocketChannel.h"
+
+// Samples are summed in blocks of this size and the block sums are added in order,
+// so that weight sums don't depend on the number of threads
+static const int sampleBlockSize = 65536;
+// Bin codes are stored as unsigned char
+static const int maxBinTotal = 256;
+// Sample indices of compact storage are stored as unsigned short if all samples fit
+static const int maxCompactIndexSampleTotal = 65536;
+// Active sample flag of samples whose weights are scaled in gradient-based sampling
+static const char scaledSampleFlag = 2;
+// Largest number of values in the summary of a feature sent by a shard worker
+static const int shardSummaryTotal = 4*maxBinTotal;
+// Memory a range of mapped columns may use beyond its size in out-of-core training: the kernel can map
+// a whole large folio (up to 2 MB) around a faulting page, at both ends of the index and value sections
+static const long long mappedRangeMarginBytes = 2*2*(2LL << 20);
+// Commands of the coordinator of sharded training
+static const int32_t shardRoundCommand = 1;
+static const int32_t shardFinishCommand = 0;
+// A stump of the initial model is applied to the weights without a histogram
+static const int32_t shardReplayCommand = 2;
+
+// Binary training sample file (written by writeTrainingSampleFile)
+// The header is followed by labels (int8, +1/-1), column offsets (uint64, featureTotal + 1),
+// sorted sample indices (int32) and sorted feature values (double), each section aligned to sampleFileAlignment.
+static const char sampleFileMagic[8] = {'A', 'B', 'S', 'A', 'M', 'P', 'L', 'E'};
+static const uint32_t sampleFileVersion = 1;
+static const uint32_t sampleFileByteOrderMark = 0x01020304;
+static const long long sampleFileAlignment = 64;
+
+struct SampleFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t sparse;
+    uint32_t reserved;
+    int64_t sampleTotal;
+    int64_t featureTotal;
+    int64_t elementTotal;
+    int64_t labelOffset;
+    int64_t columnOffsetOffset;
+    int64_t sampleIndexOffset;
+    int64_t featureValueOffset;
+};
+
+static long long alignSampleFileOffset(const long long offset) {
+    return (offset + sampleFileAlignment - 1)/sampleFileAlignment*sampleFileAlignment;
+}
+
+static bool isSampleFile(const std::string& filename) {
+    // Sample files are mapped, so they are regular files; reading the magic of a pipe would consume it
+    struct stat fileStatus;
+    if (stat(filename.c_str(), &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)) return false;
+    
+    std::ifstream inputStream(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    char magic[8];
+    if (!inputStream.read(magic, sizeof(magic))) return false;
+    return memcmp(magic, sampleFileMagic, sizeof(magic)) == 0;
+}
 
 struct SampleElement {
     int sampleIndex;
@@ -39,6 +116,271 @@ struct SampleElement {
     bool operator<(const SampleElement& comparisonElement) const { return sampleValue < comparisonElement.sampleValue; }
 };
 
+// Transposes samples into columns of (sample index, value) in sample order
+// Column d is featureElements[featureOffsets[d], featureOffsets[d+1]). If a feature appears more than once
+// in a sample, the last value is kept.
+static void transposeSampleData(const SparseSampleData& samples,
+                                const bool skipZeroValues,
+                                std::vector<size_t>& featureOffsets,
+                                std::vector<SampleElement>& featureElements)
+{
+    int sampleTotal = static_cast<int>(samples.sampleOffsets.size()) - 1;
+    int featureTotal = samples.featureDimension;
+    
+    std::vector<int> lastSampleIndices(featureTotal, -1);
+    featureOffsets.assign(featureTotal + 1, 0);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        for (long long elementIndex = samples.sampleOffsets[sampleIndex];
+             elementIndex < samples.sampleOffsets[sampleIndex + 1]; ++elementIndex)
+        {
+            int featureIndex = samples.featureIndices[elementIndex];
+            if (skipZeroValues && samples.featureValues[elementIndex] == 0) continue;
+            if (lastSampleIndices[featureIndex] == sampleIndex) continue;
+            lastSampleIndices[featureIndex] = sampleIndex;
+            ++featureOffsets[featureIndex + 1];
+        }
+    }
+    for (int featureIndex = 0; featureIndex < featureTotal; ++featureIndex) {
+        featureOffsets[featureIndex + 1] += featureOffsets[featureIndex];
+    }
+    
+    featureElements.resize(featureOffsets[featureTotal]);
+    std::vector<size_t> featureEnds(featureOffsets.begin(), featureOffsets.end() - 1);
+    lastSampleIndices.assign(featureTotal, -1);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        for (long long elementIndex = samples.sampleOffsets[sampleIndex];
+             elementIndex < samples.sampleOffsets[sampleIndex + 1]; ++elementIndex)
+        {
+            int featureIndex = samples.featureIndices[elementIndex];
+            if (skipZeroValues && samples.featureValues[elementIndex] == 0) continue;
+            if (lastSampleIndices[featureIndex] == sampleIndex) {
+                featureElements[featureEnds[featureIndex] - 1].sampleValue = samples.featureValues[elementIndex];
+                continue;
+            }
+            lastSampleIndices[featureIndex] = sampleIndex;
+            featureElements[featureEnds[featureIndex]].sampleIndex = sampleIndex;
+            featureElements[featureEnds[featureIndex]].sampleValue = samples.featureValues[elementIndex];
+            ++featureEnds[featureIndex];
+        }
+    }
+}
+
+// Expands column featureIndex of transposed samples into the values of all samples
+static void expandFeatureColumn(const std::vector<size_t>& featureOffsets,
+                                const std::vector<SampleElement>& featureElements,
+                                const int featureIndex,
+                                std::vector<SampleElement>& columnElements)
+{
+    for (int sampleIndex = 0; sampleIndex < static_cast<int>(columnElements.size()); ++sampleIndex) {
+        columnElements[sampleIndex].sampleIndex = sampleIndex;
+        columnElements[sampleIndex].sampleValue = 0;
+    }
+    for (size_t elementIndex = featureOffsets[featureIndex]; elementIndex < featureOffsets[featureIndex + 1]; ++elementIndex) {
+        columnElements[featureElements[elementIndex].sampleIndex].sampleValue = featureElements[elementIndex].sampleValue;
+    }
+}
+
+// Order-preserving integer encoding of a double for radix sorting: larger values have larger keys
+static inline uint64_t encodeSortKey(const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x8000000000000000ULL) ? ~bits : (bits | 0x8000000000000000ULL);
+}
+
+static inline double decodeSortKey(const uint64_t key) {
+    uint64_t bits = (key & 0x8000000000000000ULL) ? (key & ~0x8000000000000000ULL) : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Scratch arrays of the radix sort of a column, kept by a thread for all its columns
+struct ColumnSortBuffer {
+    std::vector<uint64_t> keys;
+    std::vector<int> indices;
+    std::vector<uint64_t> keyBuffer;
+    std::vector<int> indexBuffer;
+    
+    void reserve(const size_t length) {
+        if (keys.size() >= length) return;
+        keys.resize(length);
+        indices.resize(length);
+        keyBuffer.resize(length);
+        indexBuffer.resize(length);
+    }
+};
+
+// Stable LSD radix sort of keys[0, length) and their indices, one byte per pass
+// The histograms of all bytes are counted in one pass, and a pass is skipped if all keys have the same byte
+// (e.g. the sign and exponent of values of similar magnitude). Ties keep their order, i.e. sample order.
+static void radixSortColumn(ColumnSortBuffer& buffer, const size_t length) {
+    if (length < 2) return;
+    
+    const int passTotal = sizeof(uint64_t);
+    std::vector<size_t> byteCounts(passTotal*256, 0);
+    uint64_t* keys = &buffer.keys[0];
+    for (size_t i = 0; i < length; ++i) {
+        uint64_t key = keys[i];
+        for (int pass = 0; pass < passTotal; ++pass) ++byteCounts[pass*256 + ((key >> (8*pass)) & 0xff)];
+    }
+    
+    int* indices = &buffer.indices[0];
+    uint64_t* sortedKeys = &buffer.keyBuffer[0];
+    int* sortedIndices = &buffer.indexBuffer[0];
+    for (int pass = 0; pass < passTotal; ++pass) {
+        size_t* counts = &byteCounts[pass*256];
+        if (counts[(keys[0] >> (8*pass)) & 0xff] == length) continue;
+        
+        size_t position = 0;
+        for (int byteValue = 0; byteValue < 256; ++byteValue) {
+            size_t count = counts[byteValue];
+            counts[byteValue] = position;
+            position += count;
+        }
+        for (size_t i = 0; i < length; ++i) {
+            size_t sortedIndex = counts[(keys[i] >> (8*pass)) & 0xff]++;
+            sortedKeys[sortedIndex] = keys[i];
+            sortedIndices[sortedIndex] = indices[i];
+        }
+        std::swap(keys, sortedKeys);
+        std::swap(indices, sortedIndices);
+    }
+    if (keys != &buffer.keys[0]) {
+        buffer.keys.swap(buffer.keyBuffer);
+        buffer.indices.swap(buffer.indexBuffer);
+    }
+}
+
+// Ends of the runs of equal values in a sorted column (positions in the column); only counts them if runEnds is NULL
+template <typename ValueType>
+static size_t findTieRuns(const ValueType* sortedValues, const size_t length, int* runEnds) {
+    size_t runTotal = 0;
+    for (size_t i = 1; i <= length; ++i) {
+        if (i < length && sortedValues[i] == sortedValues[i - 1]) continue;
+        if (runEnds != NULL) runEnds[runTotal] = static_cast<int>(i);
+        ++runTotal;
+    }
+    return runTotal;
+}
+
+// Summary of the sorted values of a feature in a shard: its distinct values with their numbers of samples
+// if there are at most shardSummaryTotal of them, otherwise shardSummaryTotal values at evenly spaced ranks,
+// each counting the samples from the previous one
+static void summarizeSortedValues(const std::vector<SampleElement>& sortedElements,
+                                  std::vector<double>& summaryValues,
+                                  std::vector<int64_t>& summaryCounts)
+{
+    size_t elementTotal = sortedElements.size();
+    size_t distinctValueTotal = elementTotal > 0 ? 1 : 0;
+    for (size_t i = 1; i < elementTotal; ++i) {
+        if (sortedElements[i].sampleValue != sortedElements[i - 1].sampleValue) ++distinctValueTotal;
+    }
+    
+    summaryValues.clear();
+    summaryCounts.clear();
+    if (distinctValueTotal <= static_cast<size_t>(shardSummaryTotal)) {
+        for (size_t i = 0; i < elementTotal; ++i) {
+            if (i > 0 && sortedElements[i].sampleValue == sortedElements[i - 1].sampleValue) {
+                ++summaryCounts.back();
+            } else {
+                summaryValues.push_back(sortedElements[i].sampleValue);
+                summaryCounts.push_back(1);
+            }
+        }
+        return;
+    }
+    
+    size_t countedTotal = 0;
+    for (size_t rankIndex = 1; rankIndex <= static_cast<size_t>(shardSummaryTotal); ++rankIndex) {
+        size_t rankEnd = (elementTotal*rankIndex + shardSummaryTotal - 1)/shardSummaryTotal;
+        if (rankEnd <= countedTotal) continue;
+        double value = sortedElements[rankEnd - 1].sampleValue;
+        if (!summaryValues.empty() && summaryValues.back() == value) {
+            summaryCounts.back() += rankEnd - countedTotal;
+        } else {
+            summaryValues.push_back(value);
+            summaryCounts.push_back(rankEnd - countedTotal);
+        }
+        countedTotal = rankEnd;
+    }
+}
+
+// Bin thresholds of a feature from the merged summaries of all shards, with the rule of quantizeSortedColumn
+// applied to the counted values
+static void mergeBinThresholds(std::vector< std::pair<double, int64_t> >& valueCounts,
+                               const int binTotal,
+                               std::vector<double>& thresholds)
+{
+    std::sort(valueCounts.begin(), valueCounts.end());
+    size_t distinctValueTotal = 0;
+    for (size_t i = 0; i < valueCounts.size(); ++i) {
+        if (distinctValueTotal > 0 && valueCounts[distinctValueTotal - 1].first == valueCounts[i].first) {
+            valueCounts[distinctValueTotal - 1].second += valueCounts[i].second;
+        } else {
+            valueCounts[distinctValueTotal] = valueCounts[i];
+            ++distinctValueTotal;
+        }
+    }
+    valueCounts.resize(distinctValueTotal);
+    
+    int64_t sampleTotal = 0;
+    for (size_t i = 0; i < valueCounts.size(); ++i) sampleTotal += valueCounts[i].second;
+    
+    thresholds.clear();
+    int binIndex = 0;
+    int64_t countedTotal = 0;
+    for (size_t i = 0; i < valueCounts.size(); ++i) {
+        if (i > 0) {
+            bool nextBin;
+            if (distinctValueTotal <= static_cast<size_t>(binTotal)) nextBin = true;
+            else nextBin = countedTotal*binTotal >= static_cast<int64_t>(binIndex + 1)*sampleTotal;
+            
+            if (nextBin && binIndex < binTotal - 1) {
+                thresholds.push_back((valueCounts[i - 1].first + valueCounts[i].first)/2.0);
+                ++binIndex;
+            }
+        }
+        countedTotal += valueCounts[i].second;
+    }
+}
+
+// Copies the entries of a sorted column whose samples are active, keeping their order
+// Only counts them if activeValues is NULL.
+template <typename ValueType, typename IndexType>
+static size_t gatherActiveEntries(const ValueType* sortedValues,
+                                  const IndexType* sortedIndices,
+                                  const size_t columnLength,
+                                  const std::vector<char>& activeSampleFlags,
+                                  double* activeValues,
+                                  int* activeIndices)
+{
+    size_t activeLength = 0;
+    for (size_t sortIndex = 0; sortIndex < columnLength; ++sortIndex) {
+        if (!activeSampleFlags[sortedIndices[sortIndex]]) continue;
+        
+        if (activeValues != NULL) {
+            activeValues[activeLength] = sortedValues[sortIndex];
+            activeIndices[activeLength] = sortedIndices[sortIndex];
+        }
+        ++activeLength;
+    }
+    
+    return activeLength;
+}
+
+// Removes one sample, given by its weight multiplied by its label, from the sums of the larger side
+static inline void subtractLabelWeight(const double labelWeight,
+                                       double& weightSum,
+                                       double& weightLabelSum,
+                                       double& positiveWeightSum,
+                                       double& negativeWeightSum)
+{
+    weightSum -= fabs(labelWeight);
+    weightLabelSum -= labelWeight;
+    positiveWeightSum -= (labelWeight > 0 ? labelWeight : 0.0);
+    negativeWeightSum -= (labelWeight < 0 ? -labelWeight : 0.0);
+}
+
 void AdaBoost::DecisionStump::set(const int featureIndex,
                         const double threshold,
                         const double outputLarger,
@@ -63,6 +405,15 @@ double AdaBoost::DecisionStump::evaluate(const std::vector<double>& featureVecto
 }
 
 
+AdaBoost::AdaBoost(const int boostingType)
+    : boostingType_(boostingType), threadPool_(new ThreadPool(1)), compiled_(false), compiledZeroScore_(0), binTotal_(0), sparseTraining_(false), compactStorage_(false),
+      featureTotal_(0), checkpointInterval_(0), sampleTotal_(0), validationSampleTotal_(0),
+      earlyStoppingRoundTotal_(0), memoryBudget_(0), columnBlockBytes_(0), trimmingWeightRate_(0), trimmingRefreshInterval_(10),
+      gradientTopRate_(0), gradientOtherRate_(0), sampledWeightScale_(1.0), featureSamplingRate_(0), keptFeatureTotal_(0),
+      randomSeed_(0), pruning_(false) {}
+
+AdaBoost::~AdaBoost() {}
+
 void AdaBoost::setBoostingType(const int boostingType) {
     if (boostingType < 0 || boostingType > 2) {
         std::cerr << "error: invalid type of boosting" << std::endl;
@@ -72,23 +423,318 @@ void AdaBoost::setBoostingType(const int boostingType) {
     boostingType_ = boostingType;
 }
 
+void AdaBoost::setThreadTotal(const int threadTotal) {
+    if (threadTotal < 1) {
+        std::cerr << "error: invalid number of threads" << std::endl;
+        exit(1);
+    }
+    
+    if (threadTotal != threadPool_->threadTotal()) threadPool_.reset(new ThreadPool(threadTotal));
+}
+
+void AdaBoost::setBinTotal(const int binTotal) {
+    if (binTotal < 0 || binTotal == 1 || binTotal > maxBinTotal) {
+        std::cerr << "error: invalid number of bins" << std::endl;
+        exit(1);
+    }
+    
+    binTotal_ = binTotal;
+}
+
+void AdaBoost::setMemoryBudget(const long long megabytes) {
+    memoryBudget_ = std::max(megabytes, 0LL)*1024*1024;
+}
+
+void AdaBoost::setSparseTraining(const bool sparseTraining) {
+    sparseTraining_ = sparseTraining;
+}
+
+void AdaBoost::setCompactStorage(const bool compactStorage) {
+    compactStorage_ = compactStorage;
+}
+
+void AdaBoost::setWeightTrimming(const double weightRate, const int refreshInterval) {
+    trimmingWeightRate_ = weightRate;
+    trimmingRefreshInterval_ = std::max(refreshInterval, 1);
+}
+
+void AdaBoost::setFeatureSampling(const double featureRate, const int keptFeatureTotal) {
+    featureSamplingRate_ = featureRate;
+    keptFeatureTotal_ = keptFeatureTotal;
+}
+
+void AdaBoost::setGradientSampling(const double topRate, const double otherRate) {
+    gradientTopRate_ = topRate;
+    gradientOtherRate_ = otherRate;
+}
+
+void AdaBoost::setPruning(const bool pruning) {
+    pruning_ = pruning;
+}
+
+void AdaBoost::setRandomSeed(const unsigned int seed) {
+    randomSeed_ = seed;
+}
+
 void AdaBoost::setTrainingSamples(const std::string& trainingDataFilename) {
-    readSampleDataFile(trainingDataFilename, samples_, labels_);
-    sampleTotal_ = static_cast<int>(samples_.size());
+    sampleFile_.reset();
+    runOffsets_.clear();
+    sortedRunEnds_.clear();
+    weakClassifiers_.clear();
+    compiled_ = false;
+    cascadeThresholds_.clear();
+    activeSampleFlags_.clear();
+    activeSampleIndices_.clear();
+    keptFeatureIndices_.clear();
+    featureErrorBounds_.clear();
+    validationScores_.assign(validationSampleTotal_, 0.0);
+    
+    if (pruning_ && keptFeatureTotal_ > 0) {
+        std::cerr << "error: pruning can't be used with kept features of feature sampling" << std::endl;
+        exit(1);
+    }
+    if (compactStorage_ && binTotal_ > 0) {
+        std::cerr << "error: compact storage can't be used with binning" << std::endl;
+        exit(1);
+    }
+    if (gradientTopRate_ > 0 && (binTotal_ == 0 || trimmingWeightRate_ > 0)) {
+        std::cerr << "error: gradient-based sampling needs binning and can't be used with weight trimming" << std::endl;
+        exit(1);
+    }
+    
+    columnBlockBytes_ = 0;
+    if (memoryBudget_ > 0 && (binTotal_ > 0 || compactStorage_ || trimmingWeightRate_ > 0)) {
+        std::cerr << "error: a memory budget can't be used with binning, compact storage or weight trimming" << std::endl;
+        exit(1);
+    }
+    
+    if (isSampleFile(trainingDataFilename)) {
+        ScopedPhaseTimer timer("read_sample_file");
+        readTrainingSampleFile(trainingDataFilename);
+        return;
+    }
+    if (memoryBudget_ > 0) {
+        std::cerr << "error: a memory budget needs a binary training sample file (abconvert)" << std::endl;
+        exit(1);
+    }
+    
+    if (sparseTraining_ && binTotal_ > 0) {
+        std::cerr << "error: binning can't be used with sparse training" << std::endl;
+        exit(1);
+    }
+    
+    SparseSampleData samples;
+    std::vector<bool> sampleLabels;
+    {
+        ScopedPhaseTimer timer("parse");
+        readSampleDataFile(trainingDataFilename, samples, sampleLabels, threadPool_->threadTotal());
+    }
+    sampleTotal_ = static_cast<int>(sampleLabels.size());
     if (sampleTotal_ == 0) {
         std::cerr << "error: no training sample" << std::endl;
         exit(1);
     }
-    featureTotal_ = static_cast<int>(samples_[0].size());
+    featureTotal_ = samples.featureDimension;
+    
+    labels_.resize(sampleTotal_);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        if (sampleLabels[sampleIndex]) labels_[sampleIndex] = 1;
+        else labels_[sampleIndex] = -1;
+    }
+    
     initializeWeights();
-    sortSampleIndices();
+    ScopedPhaseTimer timer(binTotal_ > 0 ? "quantize" : "presort");
+    if (binTotal_ > 0) quantizeFeatures(samples);
+    else sortSampleIndices(samples);
+}
+
+void AdaBoost::setInitialModel(const std::string& modelFilename) {
+    if (labels_.empty()) {
+        std::cerr << "error: the initial model needs training samples" << std::endl;
+        exit(1);
+    }
     
-    weakClassifiers_.clear();
+    ScopedPhaseTimer timer("initial_model");
+    readFile(modelFilename);
+    std::vector<DecisionStump> initialClassifiers;
+    initialClassifiers.swap(weakClassifiers_);
+    compiled_ = false;
+    cascadeThresholds_.clear();
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(initialClassifiers.size()); ++classifierIndex) {
+        if (initialClassifiers[classifierIndex].featureIndex() < 0
+            || initialClassifiers[classifierIndex].featureIndex() >= featureTotal_)
+        {
+            std::cerr << "error: the initial model uses features which aren't in the training samples" << std::endl;
+            exit(1);
+        }
+    }
+    
+    // Weights are updated round by round as in training. Trimmed samples are selected at the same rounds,
+    // so that the rounds after the model use the same samples as if training hadn't stopped.
+    initializeWeights();
+    activeSampleFlags_.clear();
+    activeSampleIndices_.clear();
+    keptFeatureIndices_.clear();
+    featureErrorBounds_.assign(featureTotal_, 0.0);
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(initialClassifiers.size()); ++classifierIndex) {
+        if (gradientTopRate_ <= 0 && trimmingWeightRate_ > 0 && classifierIndex%trimmingRefreshInterval_ == 0) {
+            selectActiveSamples();
+        }
+        updateWeight(initialClassifiers[classifierIndex]);
+        weakClassifiers_.push_back(initialClassifiers[classifierIndex]);
+    }
+    
+    validationScores_.assign(validationSampleTotal_, 0.0);
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        addValidationScores(weakClassifiers_[classifierIndex]);
+    }
+}
+
+void AdaBoost::setValidationSamples(const std::string& validationDataFilename) {
+    SparseSampleData samples;
+    std::vector<bool> sampleLabels;
+    {
+        ScopedPhaseTimer timer("parse_validation");
+        readSampleDataFile(validationDataFilename, samples, sampleLabels, threadPool_->threadTotal());
+    }
+    validationSampleTotal_ = static_cast<int>(sampleLabels.size());
+    if (validationSampleTotal_ == 0) {
+        std::cerr << "error: no validation sample" << std::endl;
+        exit(1);
+    }
+    
+    validationLabels_.resize(validationSampleTotal_);
+    for (int sampleIndex = 0; sampleIndex < validationSampleTotal_; ++sampleIndex) {
+        validationLabels_[sampleIndex] = sampleLabels[sampleIndex] ? 1 : -1;
+    }
+    
+    std::vector<SampleElement> featureElements;
+    transposeSampleData(samples, true, validationColumnOffsets_, featureElements);
+    validationSampleIndices_.resize(featureElements.size());
+    validationFeatureValues_.resize(featureElements.size());
+    for (size_t elementIndex = 0; elementIndex < featureElements.size(); ++elementIndex) {
+        validationSampleIndices_[elementIndex] = featureElements[elementIndex].sampleIndex;
+        validationFeatureValues_[elementIndex] = featureElements[elementIndex].sampleValue;
+    }
+    
+    validationScores_.assign(validationSampleTotal_, 0.0);
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        addValidationScores(weakClassifiers_[classifierIndex]);
+    }
+}
+
+void AdaBoost::setEarlyStopping(const int roundTotal) {
+    earlyStoppingRoundTotal_ = std::max(roundTotal, 0);
+}
+
+void AdaBoost::setProgressFile(const std::string& filename) {
+    progressFilename_ = filename;
+}
+
+void AdaBoost::setCheckpoint(const std::string& filename, const int interval) {
+    checkpointFilename_ = filename;
+    checkpointInterval_ = std::max(interval, 0);
+}
+
+void AdaBoost::writeTrainingSampleFile(const std::string filename) const {
+    if (binTotal_ > 0 || compactStorage_) {
+        std::cerr << "error: binned or compact training samples can't be written" << std::endl;
+        exit(1);
+    }
+    
+    std::ofstream outputStream(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+    if (outputStream.fail()) {
+        std::cerr << "error: can't open file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    SampleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sampleFileMagic, sizeof(header.magic));
+    header.version = sampleFileVersion;
+    header.byteOrderMark = sampleFileByteOrderMark;
+    header.sparse = sparseTraining_ ? 1 : 0;
+    header.sampleTotal = sampleTotal_;
+    header.featureTotal = featureTotal_;
+    header.elementTotal = static_cast<int64_t>(columnOffsets_[featureTotal_]);
+    header.labelOffset = alignSampleFileOffset(sizeof(header));
+    header.columnOffsetOffset = alignSampleFileOffset(header.labelOffset + header.sampleTotal);
+    header.sampleIndexOffset = alignSampleFileOffset(header.columnOffsetOffset + (header.featureTotal + 1)*sizeof(uint64_t));
+    header.featureValueOffset = alignSampleFileOffset(header.sampleIndexOffset + header.elementTotal*sizeof(int32_t));
+    
+    std::vector<uint64_t> columnOffsets(columnOffsets_.data(), columnOffsets_.data() + featureTotal_ + 1);
+    
+    const char padding[sampleFileAlignment] = {0};
+    long long writtenSize = 0;
+    auto writeSection = [&](const long long sectionOffset, const void* sectionData, const long long sectionSize) {
+        outputStream.write(padding, sectionOffset - writtenSize);
+        outputStream.write(reinterpret_cast<const char*>(sectionData), sectionSize);
+        writtenSize = sectionOffset + sectionSize;
+    };
+    writeSection(0, &header, sizeof(header));
+    writeSection(header.labelOffset, labels_.data(), header.sampleTotal);
+    writeSection(header.columnOffsetOffset, columnOffsets.data(), (header.featureTotal + 1)*sizeof(uint64_t));
+    writeSection(header.sampleIndexOffset, sortedSampleIndices_.data(), header.elementTotal*sizeof(int32_t));
+    writeSection(header.featureValueOffset, sortedFeatureValues_.data(), header.elementTotal*sizeof(double));
+    
+    outputStream.close();
+    if (outputStream.fail()) {
+        std::cerr << "error: can't write file (" << filename << ")" << std::endl;
+        exit(1);
+    }
 }
 
 void AdaBoost::train(const int roundTotal, const bool verbose) {
-    for (int roundCount = 0; roundCount < roundTotal; ++roundCount) {
+    if (earlyStoppingRoundTotal_ > 0 && validationSampleTotal_ == 0) {
+        std::cerr << "error: early stopping needs validation samples" << std::endl;
+        exit(1);
+    }
+    if (static_cast<int>(weakClassifiers_.size()) > roundTotal) {
+        std::cerr << "error: the initial model has more rounds (" << weakClassifiers_.size() << ") than ";
+        std::cerr << "the number of rounds to train (" << roundTotal << ")" << std::endl;
+        exit(1);
+    }
+    
+    std::ofstream progressStream;
+    if (!progressFilename_.empty()) {
+        progressStream.open(progressFilename_.c_str(), std::ios_base::out);
+        if (progressStream.fail()) {
+            std::cerr << "error: can't open file (" << progressFilename_ << ")" << std::endl;
+            exit(1);
+        }
+        progressStream << "# round training_loss training_accuracy";
+        if (validationSampleTotal_ > 0) progressStream << " validation_loss validation_accuracy";
+        progressStream << std::endl;
+        progressStream << std::setprecision(10);
+    }
+    
+    // Number of rounds with the smallest validation loss so far
+    double bestValidationLoss = HUGE_VAL;
+    int bestRoundTotal = static_cast<int>(weakClassifiers_.size());
+    if (validationSampleTotal_ > 0) {
+        double validationAccuracy;
+        computeScoreStatistics(validationScores_, validationLabels_, bestValidationLoss, validationAccuracy);
+    }
+    
+    ScopedPhaseTimer timer("train");
+    while (static_cast<int>(weakClassifiers_.size()) < roundTotal) {
         trainRound();
+        int roundCount = static_cast<int>(weakClassifiers_.size()) - 1;
+        
+        // Scores are updated incrementally, so the statistics of a round need one pass over the samples
+        double trainingLoss = 0.0, trainingAccuracy = 0.0, validationLoss = 0.0, validationAccuracy = 0.0;
+        if (verbose || progressStream.is_open()) {
+            computeScoreStatistics(trainingScores_, labels_, trainingLoss, trainingAccuracy);
+        }
+        if (validationSampleTotal_ > 0) {
+            computeScoreStatistics(validationScores_, validationLabels_, validationLoss, validationAccuracy);
+        }
+        
+        if (progressStream.is_open()) {
+            progressStream << roundCount + 1 << " " << trainingLoss << " " << trainingAccuracy;
+            if (validationSampleTotal_ > 0) progressStream << " " << validationLoss << " " << validationAccuracy;
+            progressStream << std::endl;
+        }
         
         if (verbose) {
             std::cout << "Round " << roundCount << ": " << std::endl;
@@ -96,8 +742,33 @@ void AdaBoost::train(const int roundTotal, const bool verbose) {
             std::cout << "threshold = " << weakClassifiers_[roundCount].threshold() << ", ";
             std::cout << "output = [ " << weakClassifiers_[roundCount].outputLarger() << ", ";
             std::cout << weakClassifiers_[roundCount].outputSmaller() << "], ";
-            std::cout << "error = " << weakClassifiers_[roundCount].error() << std::endl;
+            std::cout << "error = " << weakClassifiers_[roundCount].error();
+            if (!activeSampleFlags_.empty()) std::cout << ", active samples = " << activeSampleIndices_.size();
+            std::cout << std::endl;
+            std::cout << "loss = " << trainingLoss << ", accuracy = " << trainingAccuracy;
+            if (validationSampleTotal_ > 0) {
+                std::cout << ", validation loss = " << validationLoss << ", validation accuracy = " << validationAccuracy;
+            }
+            std::cout << std::endl;
+        }
+        
+        if (validationSampleTotal_ > 0) {
+            if (validationLoss < bestValidationLoss) {
+                bestValidationLoss = validationLoss;
+                bestRoundTotal = roundCount + 1;
+            } else if (earlyStoppingRoundTotal_ > 0 && roundCount + 1 - bestRoundTotal >= earlyStoppingRoundTotal_) {
+                weakClassifiers_.resize(bestRoundTotal);
+                recomputeScores();
+                if (verbose) {
+                    std::cout << std::endl;
+                    std::cout << "Early stopping: validation loss hasn't decreased for " << earlyStoppingRoundTotal_;
+                    std::cout << " rounds, " << bestRoundTotal << " rounds are kept" << std::endl;
+                }
+                break;
+            }
         }
+        
+        if (checkpointInterval_ > 0 && (roundCount + 1)%checkpointInterval_ == 0) writeCheckpoint();
     }
     
     // Prediction test
@@ -107,9 +778,9 @@ void AdaBoost::train(const int roundTotal, const bool verbose) {
         int negativeTotal = 0;
         int negativeCorrectTotal = 0;
         for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
-            double score = this->predict(samples_[sampleIndex]);
+            double score = trainingScores_[sampleIndex];
             
-            if (labels_[sampleIndex]) {
+            if (labels_[sampleIndex] > 0) {
                 ++positiveTotal;
                 if (score > 0) ++positiveCorrectTotal;
             } else {
@@ -118,149 +789,1707 @@ void AdaBoost::train(const int roundTotal, const bool verbose) {
             }
         }
         
-        std::cout << std::endl;
-        std::cout << "Training set" << std::endl;
-        std::cout << "  positive: " << static_cast<double>(positiveCorrectTotal)/positiveTotal;
-        std::cout << " (" << positiveCorrectTotal << " / " << positiveTotal << "), ";
-        std::cout << "negative: " << static_cast<double>(negativeCorrectTotal)/negativeTotal;
-        std::cout << " (" << negativeCorrectTotal << " / " << negativeTotal << ")" << std::endl;;
+        std::cout << std::endl;
+        std::cout << "Training set" << std::endl;
+        std::cout << "  positive: " << static_cast<double>(positiveCorrectTotal)/positiveTotal;
+        std::cout << " (" << positiveCorrectTotal << " / " << positiveTotal << "), ";
+        std::cout << "negative: " << static_cast<double>(negativeCorrectTotal)/negativeTotal;
+        std::cout << " (" << negativeCorrectTotal << " / " << negativeTotal << ")" << std::endl;;
+    }
+}
+
+void AdaBoost::trainSharded(const std::vector<std::string>& shardFilenames, const int roundTotal,
+                            const std::string& initialModelFilename, const bool verbose)
+{
+    if (binTotal_ == 0) {
+        std::cerr << "error: sharded training needs binning" << std::endl;
+        exit(1);
+    }
+    if (trimmingWeightRate_ > 0 || gradientTopRate_ > 0 || featureSamplingRate_ > 0 || pruning_
+        || sparseTraining_ || compactStorage_ || validationSampleTotal_ > 0)
+    {
+        std::cerr << "error: sampling, pruning, sparse or compact storage and validation samples ";
+        std::cerr << "can't be used with sharded training" << std::endl;
+        exit(1);
+    }
+    if (shardFilenames.empty()) {
+        std::cerr << "error: no shard file" << std::endl;
+        exit(1);
+    }
+    
+    std::vector<DecisionStump> initialClassifiers;
+    if (!initialModelFilename.empty()) {
+        ScopedPhaseTimer timer("initial_model");
+        readFile(initialModelFilename);
+        initialClassifiers.swap(weakClassifiers_);
+        if (static_cast<int>(initialClassifiers.size()) > roundTotal) {
+            std::cerr << "error: the initial model has more rounds (" << initialClassifiers.size() << ") than ";
+            std::cerr << "the number of rounds to train (" << roundTotal << ")" << std::endl;
+            exit(1);
+        }
+    }
+    
+    // Workers are forked before anything is trained, so that they share nothing but the settings
+    int shardTotal = static_cast<int>(shardFilenames.size());
+    std::vector< std::unique_ptr<SocketChannel> > channels(shardTotal);
+    std::vector<pid_t> workerIds(shardTotal);
+    std::cout.flush();
+    for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+        int socketDescriptors[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, socketDescriptors) != 0) {
+            std::cerr << "error: can't create a socket for shard workers" << std::endl;
+            exit(1);
+        }
+        workerIds[shardIndex] = fork();
+        if (workerIds[shardIndex] < 0) {
+            std::cerr << "error: can't start a shard worker" << std::endl;
+            exit(1);
+        }
+        if (workerIds[shardIndex] == 0) {
+            ::close(socketDescriptors[0]);
+            for (int previousIndex = 0; previousIndex < shardIndex; ++previousIndex) channels[previousIndex]->close();
+            
+            AdaBoost worker(boostingType_);
+            worker.setThreadTotal(threadPool_->threadTotal());
+            worker.setBinTotal(binTotal_);
+            SocketChannel channel(socketDescriptors[1]);
+            worker.runShardWorker(channel, shardFilenames[shardIndex]);
+            _exit(0);
+        }
+        ::close(socketDescriptors[1]);
+        channels[shardIndex].reset(new SocketChannel(socketDescriptors[0]));
+    }
+    
+    weakClassifiers_.clear();
+    compiled_ = false;
+    cascadeThresholds_.clear();
+    sampleTotal_ = 0;
+    
+    // Numbers of samples and features over all shards
+    int64_t globalSampleTotal = 0;
+    int64_t globalFeatureTotal = 0;
+    for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+        globalSampleTotal += channels[shardIndex]->receiveValue<int64_t>();
+        globalFeatureTotal = std::max(globalFeatureTotal, channels[shardIndex]->receiveValue<int64_t>());
+    }
+    for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+        channels[shardIndex]->sendValue<int64_t>(globalSampleTotal);
+        channels[shardIndex]->sendValue<int64_t>(globalFeatureTotal);
+    }
+    featureTotal_ = static_cast<int>(globalFeatureTotal);
+    
+    // Bin thresholds from the merged summaries of the features
+    {
+        ScopedPhaseTimer timer("quantize");
+        std::vector< std::vector< std::pair<double, int64_t> > > featureValueCounts(featureTotal_);
+        std::vector<double> summaryValues;
+        std::vector<int64_t> summaryCounts;
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            for (int d = 0; d < featureTotal_; ++d) {
+                channels[shardIndex]->receiveArray(summaryValues);
+                channels[shardIndex]->receiveArray(summaryCounts);
+                for (size_t i = 0; i < summaryValues.size(); ++i) {
+                    featureValueCounts[d].push_back(std::make_pair(summaryValues[i], summaryCounts[i]));
+                }
+            }
+        }
+        binThresholds_.assign(featureTotal_, std::vector<double>());
+        threadPool_->run(featureTotal_, [&](const int d, const int) {
+            mergeBinThresholds(featureValueCounts[d], binTotal_, binThresholds_[d]);
+        });
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            for (int d = 0; d < featureTotal_; ++d) channels[shardIndex]->sendArray(binThresholds_[d]);
+        }
+    }
+    
+    // Histograms of all features in one message, positive then negative weights of each feature
+    std::vector<size_t> binOffsets(featureTotal_ + 1, 0);
+    for (int d = 0; d < featureTotal_; ++d) binOffsets[d + 1] = binOffsets[d] + 2*(binThresholds_[d].size() + 1);
+    std::vector<double> histogramMessage(4 + binOffsets[featureTotal_]);
+    std::vector<double> histogramSums(histogramMessage.size());
+    
+    // Each worker updates its weights with a stump and normalizes them by the sum over all shards
+    auto applyClassifier = [&](const DecisionStump& classifier) {
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            channels[shardIndex]->sendValue<int32_t>(classifier.featureIndex());
+            channels[shardIndex]->sendValue<double>(classifier.threshold());
+            channels[shardIndex]->sendValue<double>(classifier.outputLarger());
+            channels[shardIndex]->sendValue<double>(classifier.outputSmaller());
+        }
+        double updatedWeightSum = 0.0;
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            updatedWeightSum += channels[shardIndex]->receiveValue<double>();
+        }
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            channels[shardIndex]->sendValue<double>(updatedWeightSum);
+        }
+        weakClassifiers_.push_back(classifier);
+    };
+    
+    // The stumps of the initial model are replayed as in training, so the weights are those of the run it came from
+    if (!initialClassifiers.empty()) {
+        ScopedPhaseTimer timer("initial_model");
+        for (int classifierIndex = 0; classifierIndex < static_cast<int>(initialClassifiers.size()); ++classifierIndex) {
+            if (initialClassifiers[classifierIndex].featureIndex() >= featureTotal_) {
+                std::cerr << "error: the initial model uses features which aren't in the training samples" << std::endl;
+                exit(1);
+            }
+        }
+        for (int classifierIndex = 0; classifierIndex < static_cast<int>(initialClassifiers.size()); ++classifierIndex) {
+            for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+                channels[shardIndex]->sendValue<int32_t>(shardReplayCommand);
+            }
+            applyClassifier(initialClassifiers[classifierIndex]);
+        }
+    }
+    
+    ScopedPhaseTimer timer("train");
+    for (int roundCount = static_cast<int>(weakClassifiers_.size()); roundCount < roundTotal; ++roundCount) {
+        // Weight sums are added in shard order, so that the model doesn't depend on the timing of the workers
+        std::fill(histogramSums.begin(), histogramSums.end(), 0.0);
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            channels[shardIndex]->sendValue<int32_t>(shardRoundCommand);
+        }
+        for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+            channels[shardIndex]->receive(&histogramMessage[0], histogramMessage.size()*sizeof(double));
+            for (size_t i = 0; i < histogramSums.size(); ++i) histogramSums[i] += histogramMessage[i];
+        }
+        weightSum_ = histogramSums[0];
+        weightLabelSum_ = histogramSums[1];
+        positiveWeightSum_ = histogramSums[2];
+        negativeWeightSum_ = histogramSums[3];
+        
+        std::vector<DecisionStump> threadBestClassifiers(threadPool_->threadTotal());
+        ScanCounts zeroCounts = { 0, 0, 0 };
+        std::vector<ScanCounts> threadScanCounts(threadPool_->threadTotal(), zeroCounts);
+        threadPool_->run(featureTotal_, [&](const int d, const int threadIndex) {
+            const double* positiveBinWeightSums = &histogramSums[4 + binOffsets[d]];
+            const double* negativeBinWeightSums = positiveBinWeightSums + binThresholds_[d].size() + 1;
+            DecisionStump optimalClassifier = scanBinWeightSums(d, positiveBinWeightSums, negativeBinWeightSums,
+                                                                NULL, threadScanCounts[threadIndex]);
+            if (optimalClassifier.featureIndex() < 0) return;
+            if (isBetterClassifier(optimalClassifier, threadBestClassifiers[threadIndex])) {
+                threadBestClassifiers[threadIndex] = optimalClassifier;
+            }
+        });
+        DecisionStump bestClassifier;
+        for (int threadIndex = 0; threadIndex < static_cast<int>(threadBestClassifiers.size()); ++threadIndex) {
+            if (threadBestClassifiers[threadIndex].featureIndex() < 0) continue;
+            if (isBetterClassifier(threadBestClassifiers[threadIndex], bestClassifier)) {
+                bestClassifier = threadBestClassifiers[threadIndex];
+            }
+        }
+        if (bestClassifier.featureIndex() < 0) {
+            std::cerr << "error: no stump can be learned from the shards" << std::endl;
+            exit(1);
+        }
+        
+        applyClassifier(bestClassifier);
+        
+        if (verbose) {
+            std::cout << "Round " << roundCount << ": " << std::endl;
+            std::cout << "feature = " << bestClassifier.featureIndex() << ", ";
+            std::cout << "threshold = " << bestClassifier.threshold() << ", ";
+            std::cout << "output = [ " << bestClassifier.outputLarger() << ", ";
+            std::cout << bestClassifier.outputSmaller() << "], ";
+            std::cout << "error = " << bestClassifier.error() << std::endl;
+        }
+        
+        if (checkpointInterval_ > 0 && (roundCount + 1)%checkpointInterval_ == 0) writeCheckpoint();
+    }
+    
+    // Each worker reports the numbers of its samples and of those classified correctly
+    int64_t positiveTotal = 0;
+    int64_t positiveCorrectTotal = 0;
+    int64_t negativeTotal = 0;
+    int64_t negativeCorrectTotal = 0;
+    for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+        channels[shardIndex]->sendValue<int32_t>(shardFinishCommand);
+        positiveTotal += channels[shardIndex]->receiveValue<int64_t>();
+        positiveCorrectTotal += channels[shardIndex]->receiveValue<int64_t>();
+        negativeTotal += channels[shardIndex]->receiveValue<int64_t>();
+        negativeCorrectTotal += channels[shardIndex]->receiveValue<int64_t>();
+    }
+    for (int shardIndex = 0; shardIndex < shardTotal; ++shardIndex) {
+        channels[shardIndex]->close();
+        int workerStatus;
+        if (waitpid(workerIds[shardIndex], &workerStatus, 0) < 0 || !WIFEXITED(workerStatus) || WEXITSTATUS(workerStatus) != 0) {
+            std::cerr << "error: shard worker failed (" << shardFilenames[shardIndex] << ")" << std::endl;
+            exit(1);
+        }
+    }
+    
+    if (verbose) {
+        std::cout << std::endl;
+        std::cout << "Training set" << std::endl;
+        std::cout << "  positive: " << static_cast<double>(positiveCorrectTotal)/positiveTotal;
+        std::cout << " (" << positiveCorrectTotal << " / " << positiveTotal << "), ";
+        std::cout << "negative: " << static_cast<double>(negativeCorrectTotal)/negativeTotal;
+        std::cout << " (" << negativeCorrectTotal << " / " << negativeTotal << ")" << std::endl;;
+    }
+}
+
+void AdaBoost::runShardWorker(SocketChannel& channel, const std::string& shardFilename) {
+    SparseSampleData samples;
+    std::vector<bool> sampleLabels;
+    readSampleDataFile(shardFilename, samples, sampleLabels, threadPool_->threadTotal());
+    sampleTotal_ = static_cast<int>(sampleLabels.size());
+    if (sampleTotal_ == 0) {
+        std::cerr << "error: no training sample (" << shardFilename << ")" << std::endl;
+        exit(1);
+    }
+    labels_.resize(sampleTotal_);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        labels_[sampleIndex] = sampleLabels[sampleIndex] ? 1 : -1;
+    }
+    
+    channel.sendValue<int64_t>(sampleTotal_);
+    channel.sendValue<int64_t>(samples.featureDimension);
+    int64_t globalSampleTotal = channel.receiveValue<int64_t>();
+    featureTotal_ = static_cast<int>(channel.receiveValue<int64_t>());
+    samples.featureDimension = featureTotal_;
+    
+    std::vector<size_t> transposedOffsets;
+    std::vector<SampleElement> transposedElements;
+    transposeSampleData(samples, false, transposedOffsets, transposedElements);
+    std::vector<long long>().swap(samples.sampleOffsets);
+    std::vector<int>().swap(samples.featureIndices);
+    std::vector<double>().swap(samples.featureValues);
+    
+    std::vector< std::vector<double> > summaryValues(featureTotal_);
+    std::vector< std::vector<int64_t> > summaryCounts(featureTotal_);
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        std::vector<SampleElement> featureElements(sampleTotal_);
+        expandFeatureColumn(transposedOffsets, transposedElements, d, featureElements);
+        std::sort(featureElements.begin(), featureElements.end());
+        summarizeSortedValues(featureElements, summaryValues[d], summaryCounts[d]);
+    });
+    for (int d = 0; d < featureTotal_; ++d) {
+        channel.sendArray(summaryValues[d]);
+        channel.sendArray(summaryCounts[d]);
+    }
+    summaryValues.clear();
+    summaryCounts.clear();
+    
+    // A value falls into the bin of the number of thresholds smaller than it
+    binThresholds_.resize(featureTotal_);
+    for (int d = 0; d < featureTotal_; ++d) channel.receiveArray(binThresholds_[d]);
+    sampleBins_.resize(static_cast<size_t>(featureTotal_)*sampleTotal_);
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        const std::vector<double>& featureThresholds = binThresholds_[d];
+        unsigned char* featureBins = &sampleBins_[static_cast<size_t>(d)*sampleTotal_];
+        unsigned char zeroBin = static_cast<unsigned char>(std::lower_bound(featureThresholds.begin(), featureThresholds.end(), 0.0)
+                                                           - featureThresholds.begin());
+        std::fill(featureBins, featureBins + sampleTotal_, zeroBin);
+        for (size_t elementIndex = transposedOffsets[d]; elementIndex < transposedOffsets[d + 1]; ++elementIndex) {
+            double value = transposedElements[elementIndex].sampleValue;
+            featureBins[transposedElements[elementIndex].sampleIndex]
+                = static_cast<unsigned char>(std::lower_bound(featureThresholds.begin(), featureThresholds.end(), value)
+                                             - featureThresholds.begin());
+        }
+    });
+    std::vector<size_t>().swap(transposedOffsets);
+    std::vector<SampleElement>().swap(transposedElements);
+    
+    weights_.assign(sampleTotal_, 1.0/globalSampleTotal);
+    trainingScores_.assign(sampleTotal_, 0.0);
+    
+    std::vector<size_t> binOffsets(featureTotal_ + 1, 0);
+    for (int d = 0; d < featureTotal_; ++d) binOffsets[d + 1] = binOffsets[d] + 2*(binThresholds_[d].size() + 1);
+    std::vector<double> histogramMessage(4 + binOffsets[featureTotal_]);
+    int32_t command;
+    while ((command = channel.receiveValue<int32_t>()) != shardFinishCommand) {
+        if (command == shardRoundCommand) {
+            calcWeightSum();
+            histogramMessage[0] = weightSum_;
+            histogramMessage[1] = weightLabelSum_;
+            histogramMessage[2] = positiveWeightSum_;
+            histogramMessage[3] = negativeWeightSum_;
+            threadPool_->run(featureTotal_, [&](const int d, const int) {
+                double* positiveBinWeightSums = &histogramMessage[4 + binOffsets[d]];
+                accumulateBinWeightSums(d, positiveBinWeightSums, positiveBinWeightSums + binThresholds_[d].size() + 1);
+            });
+            channel.send(&histogramMessage[0], histogramMessage.size()*sizeof(double));
+        }
+        
+        int featureIndex = channel.receiveValue<int32_t>();
+        double threshold = channel.receiveValue<double>();
+        double outputLarger = channel.receiveValue<double>();
+        double outputSmaller = channel.receiveValue<double>();
+        DecisionStump classifier;
+        classifier.set(featureIndex, threshold, outputLarger, outputSmaller);
+        
+        // updateWeight normalizes the weights by the sum of this shard, which is replaced by the global sum
+        double updatedWeightSum = updateWeight(classifier);
+        channel.sendValue<double>(updatedWeightSum);
+        double weightScale = updatedWeightSum/channel.receiveValue<double>();
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) weights_[sampleIndex] *= weightScale;
+    }
+    
+    int64_t positiveTotal = 0;
+    int64_t positiveCorrectTotal = 0;
+    int64_t negativeTotal = 0;
+    int64_t negativeCorrectTotal = 0;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        if (labels_[sampleIndex] > 0) {
+            ++positiveTotal;
+            if (trainingScores_[sampleIndex] > 0) ++positiveCorrectTotal;
+        } else {
+            ++negativeTotal;
+            if (trainingScores_[sampleIndex] <= 0) ++negativeCorrectTotal;
+        }
+    }
+    channel.sendValue<int64_t>(positiveTotal);
+    channel.sendValue<int64_t>(positiveCorrectTotal);
+    channel.sendValue<int64_t>(negativeTotal);
+    channel.sendValue<int64_t>(negativeCorrectTotal);
+}
+
+void AdaBoost::addValidationScores(const DecisionStump& classifier) {
+    if (validationSampleTotal_ == 0) return;
+    
+    // Samples which aren't stored in the column have zero value
+    std::vector<double> outputs(validationSampleTotal_, classifier.evaluate(0.0));
+    int featureIndex = classifier.featureIndex();
+    if (featureIndex + 1 < static_cast<int>(validationColumnOffsets_.size())) {
+        for (size_t elementIndex = validationColumnOffsets_[featureIndex];
+             elementIndex < validationColumnOffsets_[featureIndex + 1]; ++elementIndex)
+        {
+            outputs[validationSampleIndices_[elementIndex]] = classifier.evaluate(validationFeatureValues_[elementIndex]);
+        }
+    }
+    for (int sampleIndex = 0; sampleIndex < validationSampleTotal_; ++sampleIndex) {
+        validationScores_[sampleIndex] += outputs[sampleIndex];
+    }
+}
+
+void AdaBoost::recomputeScores() {
+    trainingScores_.assign(sampleTotal_, 0.0);
+    validationScores_.assign(validationSampleTotal_, 0.0);
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        evaluateTrainingSamples(weakClassifiers_[classifierIndex], classifierOutputs_);
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            trainingScores_[sampleIndex] += classifierOutputs_[sampleIndex];
+        }
+        addValidationScores(weakClassifiers_[classifierIndex]);
+    }
+}
+
+void AdaBoost::computeScoreStatistics(const std::vector<double>& scores,
+                                      const std::vector<signed char>& labels,
+                                      double& loss,
+                                      double& accuracy) const
+{
+    int sampleTotal = static_cast<int>(scores.size());
+    int blockTotal = (sampleTotal + sampleBlockSize - 1)/sampleBlockSize;
+    std::vector<double> blockLossSums(blockTotal, 0.0);
+    std::vector<int> blockCorrectTotals(blockTotal, 0);
+    threadPool_->run(blockTotal, [&](const int blockIndex, const int) {
+        int sampleBegin = blockIndex*sampleBlockSize;
+        int sampleEnd = std::min(sampleBegin + sampleBlockSize, sampleTotal);
+        for (int sampleIndex = sampleBegin; sampleIndex < sampleEnd; ++sampleIndex) {
+            blockLossSums[blockIndex] += exp(-1.0*labels[sampleIndex]*scores[sampleIndex]);
+            if ((labels[sampleIndex] > 0) == (scores[sampleIndex] > 0)) ++blockCorrectTotals[blockIndex];
+        }
+    });
+    
+    // Exponential loss averaged over the samples
+    double lossSum = 0.0;
+    int correctTotal = 0;
+    for (int blockIndex = 0; blockIndex < blockTotal; ++blockIndex) {
+        lossSum += blockLossSums[blockIndex];
+        correctTotal += blockCorrectTotals[blockIndex];
+    }
+    loss = lossSum/sampleTotal;
+    accuracy = static_cast<double>(correctTotal)/sampleTotal;
+}
+
+void AdaBoost::calibrateCascade(const double detectionRate, const bool verbose) {
+    int roundTotal = static_cast<int>(weakClassifiers_.size());
+    
+    std::vector<double> scores(sampleTotal_, 0.0);
+    for (int classifierIndex = 0; classifierIndex < roundTotal; ++classifierIndex) {
+        evaluateTrainingSamples(weakClassifiers_[classifierIndex], classifierOutputs_);
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            scores[sampleIndex] += classifierOutputs_[sampleIndex];
+        }
+    }
+    
+    // Detected positives in descending order of score
+    std::vector<int> protectedIndices;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        if (labels_[sampleIndex] > 0 && scores[sampleIndex] > 0) protectedIndices.push_back(sampleIndex);
+    }
+    int detectedTotal = static_cast<int>(protectedIndices.size());
+    std::sort(protectedIndices.begin(), protectedIndices.end(), [&](const int firstIndex, const int secondIndex) {
+        if (scores[firstIndex] != scores[secondIndex]) return scores[firstIndex] > scores[secondIndex];
+        return firstIndex < secondIndex;
+    });
+    protectedIndices.resize(static_cast<int>(ceil(detectionRate*detectedTotal)));
+    
+    cascadeThresholds_.clear();
+    if (protectedIndices.empty()) {
+        std::cerr << "warning: no positive training sample is detected, the cascade is not calibrated" << std::endl;
+        return;
+    }
+    
+    // Thresholds from the partial sums, and the rejection of the training samples for the statistics
+    cascadeThresholds_.resize(roundTotal);
+    std::fill(scores.begin(), scores.end(), 0.0);
+    std::vector<char> rejected(sampleTotal_, 0);
+    long long evaluatedStumpTotal = 0;
+    for (int classifierIndex = 0; classifierIndex < roundTotal; ++classifierIndex) {
+        evaluateTrainingSamples(weakClassifiers_[classifierIndex], classifierOutputs_);
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            scores[sampleIndex] += classifierOutputs_[sampleIndex];
+        }
+        
+        double threshold = scores[protectedIndices[0]];
+        for (int protectedIndex = 1; protectedIndex < static_cast<int>(protectedIndices.size()); ++protectedIndex) {
+            threshold = std::min(threshold, scores[protectedIndices[protectedIndex]]);
+        }
+        cascadeThresholds_[classifierIndex] = threshold;
+        
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            if (rejected[sampleIndex]) continue;
+            
+            ++evaluatedStumpTotal;
+            if (scores[sampleIndex] < threshold) rejected[sampleIndex] = 1;
+        }
+    }
+    
+    if (verbose) {
+        int positiveTotal = 0;
+        int acceptedPositiveTotal = 0;
+        int negativeTotal = 0;
+        int rejectedNegativeTotal = 0;
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            if (labels_[sampleIndex] > 0) {
+                ++positiveTotal;
+                if (!rejected[sampleIndex]) ++acceptedPositiveTotal;
+            } else {
+                ++negativeTotal;
+                if (rejected[sampleIndex]) ++rejectedNegativeTotal;
+            }
+        }
+        
+        std::cout << std::endl;
+        std::cout << "Cascade (training set)" << std::endl;
+        std::cout << "  positive: " << static_cast<double>(acceptedPositiveTotal)/positiveTotal;
+        std::cout << " (" << acceptedPositiveTotal << " / " << positiveTotal << "), ";
+        std::cout << "negative: " << static_cast<double>(rejectedNegativeTotal)/negativeTotal;
+        std::cout << " (" << rejectedNegativeTotal << " / " << negativeTotal << ")" << std::endl;
+        std::cout << "  stumps per sample: " << static_cast<double>(evaluatedStumpTotal)/sampleTotal_;
+        std::cout << " (of " << roundTotal << ")" << std::endl;
+    }
+}
+
+double AdaBoost::predict(const std::vector<double>& featureVector) const {
+    if (compiled_) {
+        double score = 0.0;
+        for (int usedIndex = 0; usedIndex < static_cast<int>(compiledFeatureIndices_.size()); ++usedIndex) {
+            int thresholdBegin = compiledThresholdOffsets_[usedIndex];
+            int thresholdTotal = compiledThresholdOffsets_[usedIndex + 1] - thresholdBegin;
+            int largerTotal = countSmallerThresholds(&compiledThresholds_[thresholdBegin], thresholdTotal,
+                                                     featureVector[compiledFeatureIndices_[usedIndex]]);
+            score += compiledScores_[thresholdBegin + usedIndex + largerTotal];
+        }
+        
+        return score;
+    }
+    
+    double score = 0.0;
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        score += weakClassifiers_[classifierIndex].evaluate(featureVector);
+    }
+    
+    return score;
+}
+
+double AdaBoost::predict(const double* features, const int featureTotal) const {
+    return predictFeatures(features, featureTotal);
+}
+
+double AdaBoost::predict(const float* features, const int featureTotal) const {
+    return predictFeatures(features, featureTotal);
+}
+
+template <typename T>
+double AdaBoost::predictFeatures(const T* features, const int featureTotal) const {
+    // The stumps are added in round order like predictBatch, so that the scores are the same to the last bit
+    if (compiled_) {
+        double score = 0.0;
+        for (int classifierIndex = 0; classifierIndex < static_cast<int>(stumpFeatureIndices_.size()); ++classifierIndex) {
+            int featureIndex = stumpFeatureIndices_[classifierIndex];
+            double featureValue = featureIndex < featureTotal ? static_cast<double>(features[featureIndex]) : 0.0;
+            if (featureValue > stumpThresholds_[classifierIndex]) score += stumpOutputsLarger_[classifierIndex];
+            else score += stumpOutputsSmaller_[classifierIndex];
+        }
+        
+        return score;
+    }
+    
+    double score = 0.0;
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        int featureIndex = weakClassifiers_[classifierIndex].featureIndex();
+        double featureValue = featureIndex < featureTotal ? static_cast<double>(features[featureIndex]) : 0.0;
+        score += weakClassifiers_[classifierIndex].evaluate(featureValue);
+    }
+    
+    return score;
+}
+
+double AdaBoost::predictSparse(const int* featureIndices, const double* featureValues, const int elementTotal) const {
+    double score = compiledZeroScore_;
+    for (int elementIndex = 0; elementIndex < elementTotal; ++elementIndex) {
+        int featureIndex = featureIndices[elementIndex];
+        if (featureIndex < 0 || featureIndex >= static_cast<int>(compiledUsedIndices_.size())) continue;
+        int usedIndex = compiledUsedIndices_[featureIndex];
+        if (usedIndex < 0) continue;
+        
+        int thresholdBegin = compiledThresholdOffsets_[usedIndex];
+        int thresholdTotal = compiledThresholdOffsets_[usedIndex + 1] - thresholdBegin;
+        int largerTotal = countSmallerThresholds(&compiledThresholds_[thresholdBegin], thresholdTotal, featureValues[elementIndex]);
+        score += compiledScores_[thresholdBegin + usedIndex + largerTotal] - compiledZeroScores_[usedIndex];
+    }
+    
+    return score;
+}
+
+
+void AdaBoost::readTrainingSampleFile(const std::string& filename) {
+    sampleFile_.reset(new MappedFile());
+    if (!sampleFile_->open(filename)) {
+        std::cerr << "error: can't open file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    SampleFileHeader header;
+    bool validFile = sampleFile_->size() >= static_cast<long long>(sizeof(header));
+    if (validFile) {
+        memcpy(&header, sampleFile_->data(), sizeof(header));
+        validFile = header.version == sampleFileVersion && header.byteOrderMark == sampleFileByteOrderMark
+                    && header.sampleTotal > 0 && header.sampleTotal <= INT32_MAX
+                    && header.featureTotal >= 0 && header.featureTotal <= INT32_MAX && header.elementTotal >= 0
+                    && header.labelOffset + header.sampleTotal <= sampleFile_->size()
+                    && header.columnOffsetOffset + (header.featureTotal + 1)*8 <= sampleFile_->size()
+                    && header.sampleIndexOffset + header.elementTotal*4 <= sampleFile_->size()
+                    && header.featureValueOffset + header.elementTotal*8 <= sampleFile_->size()
+                    && sizeof(size_t) == sizeof(uint64_t);
+    }
+    if (!validFile) {
+        std::cerr << "error: bad format in training sample file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    sampleTotal_ = static_cast<int>(header.sampleTotal);
+    featureTotal_ = static_cast<int>(header.featureTotal);
+    sparseTraining_ = (header.sparse != 0);
+    
+    const signed char* fileLabels = reinterpret_cast<const signed char*>(sampleFile_->data() + header.labelOffset);
+    labels_.assign(fileLabels, fileLabels + sampleTotal_);
+    columnOffsets_.setView(reinterpret_cast<const size_t*>(sampleFile_->data() + header.columnOffsetOffset), featureTotal_ + 1);
+    sortedSampleIndices_.setView(reinterpret_cast<const int*>(sampleFile_->data() + header.sampleIndexOffset), header.elementTotal);
+    sortedFeatureValues_.setView(reinterpret_cast<const double*>(sampleFile_->data() + header.featureValueOffset), header.elementTotal);
+    if (columnOffsets_[featureTotal_] != static_cast<size_t>(header.elementTotal)) {
+        std::cerr << "error: bad format in training sample file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    initializeWeights();
+    if (memoryBudget_ > 0) {
+        setColumnBlockBytes();
+    } else if (binTotal_ > 0) {
+        if (sparseTraining_) {
+            std::cerr << "error: binning can't be used with sparse training" << std::endl;
+            exit(1);
+        }
+        
+        quantizeSortedColumns();
+        sampleFile_.reset();
+    } else if (compactStorage_) {
+        // Mapped columns are converted to compact storage; mapped pages which aren't read again don't use memory
+        compactFeatureValues_.resize(header.elementTotal);
+        float* compactFeatureValues = compactFeatureValues_.mutableData();
+        for (long long elementIndex = 0; elementIndex < header.elementTotal; ++elementIndex) {
+            compactFeatureValues[elementIndex] = static_cast<float>(sortedFeatureValues_[elementIndex]);
+        }
+        sortedFeatureValues_.clear();
+        sampleFile_->adviseDontNeed(header.featureValueOffset, header.elementTotal*sizeof(double));
+        if (hasCompactSampleIndices()) {
+            compactSampleIndices_.resize(header.elementTotal);
+            unsigned short* compactSampleIndices = compactSampleIndices_.mutableData();
+            for (long long elementIndex = 0; elementIndex < header.elementTotal; ++elementIndex) {
+                compactSampleIndices[elementIndex] = static_cast<unsigned short>(sortedSampleIndices_[elementIndex]);
+            }
+            sortedSampleIndices_.clear();
+            sampleFile_->adviseDontNeed(header.sampleIndexOffset, header.elementTotal*sizeof(int32_t));
+        }
+    }
+    if (memoryBudget_ == 0 && binTotal_ == 0) computeTieRuns();
+}
+
+void AdaBoost::setColumnBlockBytes() {
+    // Everything but the mapped columns is resident: the per-sample arrays of training, the scan buffer
+    // of every thread and the per-feature arrays of a round
+    long long residentBytes = static_cast<long long>(Profiler::peakResidentKilobytes())*1024
+                              + static_cast<long long>(sampleTotal_)*(sizeof(signed char) + 4*sizeof(double))
+                              + static_cast<long long>(threadPool_->threadTotal())*sampleTotal_*sizeof(double)
+                              + static_cast<long long>(featureTotal_ + 1)*(sizeof(size_t) + 2*sizeof(double) + 2*sizeof(int));
+    long long largestColumnBytes = 0;
+    for (int d = 0; d < featureTotal_; ++d) {
+        long long columnBytes = static_cast<long long>(columnOffsets_[d + 1] - columnOffsets_[d])*(sizeof(int) + sizeof(double));
+        largestColumnBytes = std::max(largestColumnBytes, columnBytes);
+    }
+    
+    // Pages read ahead are in the page cache, so only the block being scanned is resident
+    columnBlockBytes_ = memoryBudget_ - residentBytes;
+    if (columnBlockBytes_ < largestColumnBytes + mappedRangeMarginBytes) {
+        long long neededMegabytes = (residentBytes + largestColumnBytes + mappedRangeMarginBytes + 1024*1024 - 1)/(1024*1024);
+        std::cerr << "error: memory budget is too small (at least " << neededMegabytes << " MB)" << std::endl;
+        exit(1);
+    }
+    
+    sampleFile_->adviseDontNeed(0, sampleFile_->size());
+    adviseColumns(0, featureTotal_, MappedFile::Sequential);
+}
+
+void AdaBoost::adviseColumns(const int featureBegin, const int featureEnd, const MappedFile::Advice advice) const {
+    size_t elementBegin = columnOffsets_[featureBegin];
+    long long elementTotal = static_cast<long long>(columnOffsets_[featureEnd] - elementBegin);
+    long long indexOffset = reinterpret_cast<const char*>(sortedSampleIndices_.data() + elementBegin) - sampleFile_->data();
+    long long valueOffset = reinterpret_cast<const char*>(sortedFeatureValues_.data() + elementBegin) - sampleFile_->data();
+    sampleFile_->advise(indexOffset, elementTotal*sizeof(int), advice);
+    sampleFile_->advise(valueOffset, elementTotal*sizeof(double), advice);
+}
+
+void AdaBoost::adviseCandidateColumns(const std::vector<int>& candidateFeatures,
+                                      const std::vector<int>& candidateIndices,
+                                      const int begin,
+                                      const int end,
+                                      const MappedFile::Advice advice) const
+{
+    // Consecutive features are given as one range
+    int position = begin;
+    while (position < end) {
+        int featureBegin = candidateFeatures[candidateIndices[position]];
+        int featureEnd = featureBegin + 1;
+        ++position;
+        while (position < end && candidateFeatures[candidateIndices[position]] == featureEnd) {
+            ++featureEnd;
+            ++position;
+        }
+        adviseColumns(featureBegin, featureEnd, advice);
+    }
+}
+
+void AdaBoost::predictBatch(const double* samples,
+                            const int sampleTotal,
+                            const long long stride,
+                            const SampleLayout layout,
+                            double* scores,
+                            const SampleColumns columns) const
+{
+    if (columns == UsedFeatures && !compiled_) {
+        std::cerr << "error: the model has to be compiled to score samples of its used features" << std::endl;
+        exit(1);
+    }
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) scores[sampleIndex] = 0.0;
+    
+    std::vector<int> featureIndices;
+    std::vector<double> thresholds, outputsLarger, outputsSmaller;
+    StumpArrays stumps;
+    stumps.stumpTotal = static_cast<int>(weakClassifiers_.size());
+    if (compiled_) {
+        stumps.featureIndices = (columns == UsedFeatures) ? stumpUsedIndices_.data() : stumpFeatureIndices_.data();
+        stumps.thresholds = stumpThresholds_.data();
+        stumps.outputsLarger = stumpOutputsLarger_.data();
+        stumps.outputsSmaller = stumpOutputsSmaller_.data();
+    } else {
+        for (int classifierIndex = 0; classifierIndex < stumps.stumpTotal; ++classifierIndex) {
+            featureIndices.push_back(weakClassifiers_[classifierIndex].featureIndex());
+            thresholds.push_back(weakClassifiers_[classifierIndex].threshold());
+            outputsLarger.push_back(weakClassifiers_[classifierIndex].outputLarger());
+            outputsSmaller.push_back(weakClassifiers_[classifierIndex].outputSmaller());
+        }
+        stumps.featureIndices = featureIndices.data();
+        stumps.thresholds = thresholds.data();
+        stumps.outputsLarger = outputsLarger.data();
+        stumps.outputsSmaller = outputsSmaller.data();
+    }
+    
+    if (layout == RowMajor) addStumpOutputs(stumps, samples, sampleTotal, stride, 1, scores);
+    else addStumpOutputs(stumps, samples, sampleTotal, 1, stride, scores);
+}
+
+long long AdaBoost::predictCascade(const double* samples,
+                                   const int sampleTotal,
+                                   const long long stride,
+                                   const SampleLayout layout,
+                                   double* scores,
+                                   const SampleColumns columns) const
+{
+    if (columns == UsedFeatures && !compiled_) {
+        std::cerr << "error: the model has to be compiled to score samples of its used features" << std::endl;
+        exit(1);
+    }
+    int roundTotal = static_cast<int>(weakClassifiers_.size());
+    if (cascadeThresholds_.empty()) {
+        predictBatch(samples, sampleTotal, stride, layout, scores, columns);
+        return static_cast<long long>(sampleTotal)*roundTotal;
+    }
+    
+    long long sampleStride = (layout == RowMajor) ? stride : 1;
+    long long featureStride = (layout == RowMajor) ? 1 : stride;
+    
+    // Samples still being scored, compacted after every round
+    std::vector<int> activeIndices(sampleTotal);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        activeIndices[sampleIndex] = sampleIndex;
+        scores[sampleIndex] = 0.0;
+    }
+    int activeTotal = sampleTotal;
+    long long evaluatedStumpTotal = 0;
+    for (int classifierIndex = 0; classifierIndex < roundTotal && activeTotal > 0; ++classifierIndex) {
+        const DecisionStump& classifier = weakClassifiers_[classifierIndex];
+        long long columnIndex = (columns == UsedFeatures) ? stumpUsedIndices_[classifierIndex] : classifier.featureIndex();
+        const double* featureValues = samples + columnIndex*featureStride;
+        double threshold = cascadeThresholds_[classifierIndex];
+        
+        evaluatedStumpTotal += activeTotal;
+        int nextActiveTotal = 0;
+        for (int activeIndex = 0; activeIndex < activeTotal; ++activeIndex) {
+            int sampleIndex = activeIndices[activeIndex];
+            double score = scores[sampleIndex] + classifier.evaluate(featureValues[sampleIndex*sampleStride]);
+            if (score < threshold) {
+                scores[sampleIndex] = std::min(score, 0.0);
+            } else {
+                scores[sampleIndex] = score;
+                activeIndices[nextActiveTotal] = sampleIndex;
+                ++nextActiveTotal;
+            }
+        }
+        activeTotal = nextActiveTotal;
+    }
+    
+    return evaluatedStumpTotal;
+}
+
+int AdaBoost::featureDimension() const {
+    int dimension = 0;
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        dimension = std::max(dimension, weakClassifiers_[classifierIndex].featureIndex() + 1);
+    }
+    
+    return dimension;
+}
+
+void AdaBoost::compile() {
+    // Stumps of the same feature sorted by threshold
+    std::vector< std::pair<int, int> > featureStumps(weakClassifiers_.size());
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        featureStumps[classifierIndex] = std::make_pair(weakClassifiers_[classifierIndex].featureIndex(), classifierIndex);
+    }
+    std::sort(featureStumps.begin(), featureStumps.end(),
+              [&](const std::pair<int, int>& firstStump, const std::pair<int, int>& secondStump) {
+        if (firstStump.first != secondStump.first) return firstStump.first < secondStump.first;
+        return weakClassifiers_[firstStump.second].threshold() < weakClassifiers_[secondStump.second].threshold();
+    });
+    
+    compiledFeatureIndices_.clear();
+    compiledThresholdOffsets_.assign(1, 0);
+    compiledThresholds_.clear();
+    compiledScores_.clear();
+    int stumpBegin = 0;
+    while (stumpBegin < static_cast<int>(featureStumps.size())) {
+        int stumpEnd = stumpBegin;
+        while (stumpEnd < static_cast<int>(featureStumps.size()) && featureStumps[stumpEnd].first == featureStumps[stumpBegin].first) {
+            ++stumpEnd;
+        }
+        int stumpTotal = stumpEnd - stumpBegin;
+        
+        // Score for values larger than p thresholds = sum of outputLarger of the first p stumps
+        // + sum of outputSmaller of the others
+        std::vector<double> largerSums(stumpTotal + 1, 0.0);
+        std::vector<double> smallerSums(stumpTotal + 1, 0.0);
+        for (int p = 0; p < stumpTotal; ++p) {
+            largerSums[p + 1] = largerSums[p] + weakClassifiers_[featureStumps[stumpBegin + p].second].outputLarger();
+        }
+        for (int p = stumpTotal - 1; p >= 0; --p) {
+            smallerSums[p] = smallerSums[p + 1] + weakClassifiers_[featureStumps[stumpBegin + p].second].outputSmaller();
+        }
+        
+        compiledFeatureIndices_.push_back(featureStumps[stumpBegin].first);
+        for (int p = 0; p < stumpTotal; ++p) {
+            compiledThresholds_.push_back(weakClassifiers_[featureStumps[stumpBegin + p].second].threshold());
+        }
+        compiledThresholdOffsets_.push_back(static_cast<int>(compiledThresholds_.size()));
+        for (int p = 0; p <= stumpTotal; ++p) compiledScores_.push_back(largerSums[p] + smallerSums[p]);
+        
+        stumpBegin = stumpEnd;
+    }
+    
+    compiledUsedIndices_.assign(featureDimension(), -1);
+    compiledZeroScores_.resize(compiledFeatureIndices_.size());
+    compiledZeroScore_ = 0.0;
+    for (int usedIndex = 0; usedIndex < static_cast<int>(compiledFeatureIndices_.size()); ++usedIndex) {
+        compiledUsedIndices_[compiledFeatureIndices_[usedIndex]] = usedIndex;
+        int thresholdBegin = compiledThresholdOffsets_[usedIndex];
+        int thresholdTotal = compiledThresholdOffsets_[usedIndex + 1] - thresholdBegin;
+        compiledZeroScores_[usedIndex] = compiledScores_[thresholdBegin + usedIndex
+                                                         + countSmallerThresholds(&compiledThresholds_[thresholdBegin], thresholdTotal, 0.0)];
+        compiledZeroScore_ += compiledZeroScores_[usedIndex];
+    }
+    
+    stumpUsedIndices_.resize(weakClassifiers_.size());
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        stumpUsedIndices_[classifierIndex] = compiledUsedIndices_[weakClassifiers_[classifierIndex].featureIndex()];
+    }
+    stumpFeatureIndices_.resize(weakClassifiers_.size());
+    stumpThresholds_.resize(weakClassifiers_.size());
+    stumpOutputsLarger_.resize(weakClassifiers_.size());
+    stumpOutputsSmaller_.resize(weakClassifiers_.size());
+    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
+        stumpFeatureIndices_[classifierIndex] = weakClassifiers_[classifierIndex].featureIndex();
+        stumpThresholds_[classifierIndex] = weakClassifiers_[classifierIndex].threshold();
+        stumpOutputsLarger_[classifierIndex] = weakClassifiers_[classifierIndex].outputLarger();
+        stumpOutputsSmaller_[classifierIndex] = weakClassifiers_[classifierIndex].outputSmaller();
+    }
+    
+    compiled_ = true;
+}
+
+int AdaBoost::countSmallerThresholds(const double* thresholds, const int thresholdTotal, const double featureValue) {
+    // Branchless lower bound (NaN is larger than no threshold, as in DecisionStump::evaluate)
+    if (thresholdTotal == 0) return 0;
+    
+    const double* base = thresholds;
+    int length = thresholdTotal;
+    while (length > 1) {
+        int half = length/2;
+        base = (base[half] < featureValue) ? base + half : base;
+        length -= half;
+    }
+    return static_cast<int>(base - thresholds) + (*base < featureValue ? 1 : 0);
+}
+
+
+void AdaBoost::initializeWeights() {
+    double initialWeight = 1.0/sampleTotal_;
+    
+    weights_.resize(sampleTotal_);
+    for (int i = 0; i < sampleTotal_; ++i) weights_[i] = initialWeight;
+    trainingScores_.assign(sampleTotal_, 0.0);
+}
+
+void AdaBoost::writeCheckpoint() const {
+    // The checkpoint is replaced only after it is completely written, so that a killed run leaves the last one
+    std::string temporaryFilename = checkpointFilename_ + ".tmp";
+    writeFile(temporaryFilename);
+    if (rename(temporaryFilename.c_str(), checkpointFilename_.c_str()) != 0) {
+        std::cerr << "error: can't write file (" << checkpointFilename_ << ")" << std::endl;
+        exit(1);
+    }
+}
+
+void AdaBoost::sortSampleIndices(SparseSampleData& samples) {
+    std::vector<size_t> featureOffsets;
+    std::vector<SampleElement> featureElements;
+    transposeSampleData(samples, sparseTraining_, featureOffsets, featureElements);
+    std::vector<long long>().swap(samples.sampleOffsets);
+    std::vector<int>().swap(samples.featureIndices);
+    std::vector<double>().swap(samples.featureValues);
+    
+    // Sparse training keeps only nonzero values, dense training keeps the values of all samples
+    columnOffsets_.resize(featureTotal_ + 1);
+    size_t* columnOffsets = columnOffsets_.mutableData();
+    for (int d = 0; d <= featureTotal_; ++d) {
+        if (sparseTraining_) columnOffsets[d] = featureOffsets[d];
+        else columnOffsets[d] = static_cast<size_t>(d)*sampleTotal_;
+    }
+    sortedSampleIndices_.clear();
+    sortedFeatureValues_.clear();
+    compactSampleIndices_.clear();
+    compactFeatureValues_.clear();
+    if (compactStorage_) compactFeatureValues_.resize(columnOffsets_[featureTotal_]);
+    else sortedFeatureValues_.resize(columnOffsets_[featureTotal_]);
+    if (hasCompactSampleIndices()) compactSampleIndices_.resize(columnOffsets_[featureTotal_]);
+    else sortedSampleIndices_.resize(columnOffsets_[featureTotal_]);
+    int* sortedSampleIndices = sortedSampleIndices_.mutableData();
+    double* sortedFeatureValues = sortedFeatureValues_.mutableData();
+    unsigned short* compactSampleIndices = compactSampleIndices_.mutableData();
+    float* compactFeatureValues = compactFeatureValues_.mutableData();
+    
+    std::vector<ColumnSortBuffer> sortBuffers(threadPool_->threadTotal());
+    threadPool_->run(featureTotal_, [&](const int d, const int threadIndex) {
+        ColumnSortBuffer& sortBuffer = sortBuffers[threadIndex];
+        size_t columnBegin = columnOffsets_[d];
+        int columnLength = static_cast<int>(columnOffsets_[d + 1] - columnBegin);
+        sortBuffer.reserve(columnLength);
+        if (sparseTraining_) {
+            for (int i = 0; i < columnLength; ++i) {
+                sortBuffer.keys[i] = encodeSortKey(featureElements[featureOffsets[d] + i].sampleValue);
+                sortBuffer.indices[i] = featureElements[featureOffsets[d] + i].sampleIndex;
+            }
+        } else {
+            std::fill(sortBuffer.keys.begin(), sortBuffer.keys.begin() + columnLength, encodeSortKey(0.0));
+            for (int i = 0; i < columnLength; ++i) sortBuffer.indices[i] = i;
+            for (size_t elementIndex = featureOffsets[d]; elementIndex < featureOffsets[d + 1]; ++elementIndex) {
+                sortBuffer.keys[featureElements[elementIndex].sampleIndex] = encodeSortKey(featureElements[elementIndex].sampleValue);
+            }
+        }
+        radixSortColumn(sortBuffer, columnLength);
+        
+        for (int i = 0; i < columnLength; ++i) {
+            if (compactSampleIndices != NULL) {
+                compactSampleIndices[columnBegin + i] = static_cast<unsigned short>(sortBuffer.indices[i]);
+            } else {
+                sortedSampleIndices[columnBegin + i] = sortBuffer.indices[i];
+            }
+            if (compactFeatureValues != NULL) {
+                compactFeatureValues[columnBegin + i] = static_cast<float>(decodeSortKey(sortBuffer.keys[i]));
+            } else {
+                sortedFeatureValues[columnBegin + i] = decodeSortKey(sortBuffer.keys[i]);
+            }
+        }
+    });
+    
+    computeTieRuns();
+}
+
+void AdaBoost::computeTieRuns() {
+    runOffsets_.assign(featureTotal_ + 1, 0);
+    auto findColumnRuns = [&](const int d, int* runEnds) {
+        size_t columnBegin = columnOffsets_[d];
+        size_t columnLength = columnOffsets_[d + 1] - columnBegin;
+        if (compactStorage_) return findTieRuns(compactFeatureValues_.data() + columnBegin, columnLength, runEnds);
+        return findTieRuns(sortedFeatureValues_.data() + columnBegin, columnLength, runEnds);
+    };
+    
+    // Runs are kept only for columns with at least two values per run on average, which bounds their memory
+    // by 2 bytes per value; the scan finds the runs of the other columns by comparing values
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        size_t runTotal = findColumnRuns(d, NULL);
+        if (2*runTotal <= columnOffsets_[d + 1] - columnOffsets_[d]) runOffsets_[d + 1] = runTotal;
+    });
+    for (int d = 0; d < featureTotal_; ++d) runOffsets_[d + 1] += runOffsets_[d];
+    sortedRunEnds_.resize(runOffsets_[featureTotal_]);
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        if (runOffsets_[d + 1] > runOffsets_[d]) findColumnRuns(d, sortedRunEnds_.data() + runOffsets_[d]);
+    });
+}
+
+void AdaBoost::quantizeFeatures(const SparseSampleData& samples) {
+    std::vector<size_t> transposedOffsets;
+    std::vector<SampleElement> transposedElements;
+    transposeSampleData(samples, false, transposedOffsets, transposedElements);
+    
+    columnOffsets_.clear();
+    sortedFeatureValues_.clear();
+    sortedSampleIndices_.clear();
+    sampleBins_.resize(static_cast<size_t>(featureTotal_)*sampleTotal_);
+    binThresholds_.resize(featureTotal_);
+    
+    std::vector<ColumnSortBuffer> sortBuffers(threadPool_->threadTotal());
+    std::vector< std::vector<double> > threadSortedValues(threadPool_->threadTotal(), std::vector<double>(sampleTotal_));
+    threadPool_->run(featureTotal_, [&](const int d, const int threadIndex) {
+        ColumnSortBuffer& sortBuffer = sortBuffers[threadIndex];
+        sortBuffer.reserve(sampleTotal_);
+        std::fill(sortBuffer.keys.begin(), sortBuffer.keys.begin() + sampleTotal_, encodeSortKey(0.0));
+        for (int i = 0; i < sampleTotal_; ++i) sortBuffer.indices[i] = i;
+        for (size_t elementIndex = transposedOffsets[d]; elementIndex < transposedOffsets[d + 1]; ++elementIndex) {
+            sortBuffer.keys[transposedElements[elementIndex].sampleIndex] = encodeSortKey(transposedElements[elementIndex].sampleValue);
+        }
+        radixSortColumn(sortBuffer, sampleTotal_);
+        
+        std::vector<double>& sortedValues = threadSortedValues[threadIndex];
+        for (int i = 0; i < sampleTotal_; ++i) sortedValues[i] = decodeSortKey(sortBuffer.keys[i]);
+        quantizeSortedColumn(d, sortedValues.data(), sortBuffer.indices.data());
+    });
+}
+
+void AdaBoost::quantizeSortedColumns() {
+    sampleBins_.resize(static_cast<size_t>(featureTotal_)*sampleTotal_);
+    binThresholds_.resize(featureTotal_);
+    
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        quantizeSortedColumn(d, sortedFeatureValues_.data() + columnOffsets_[d], sortedSampleIndices_.data() + columnOffsets_[d]);
+    });
+    
+    columnOffsets_.clear();
+    sortedFeatureValues_.clear();
+    sortedSampleIndices_.clear();
+}
+
+void AdaBoost::quantizeSortedColumn(const int featureIndex, const double* sortedValues, const int* sortedIndices) {
+    int distinctValueTotal = 1;
+    for (int i = 1; i < sampleTotal_; ++i) {
+        if (sortedValues[i] != sortedValues[i - 1]) ++distinctValueTotal;
+    }
+    
+    // Bins hold about the same number of samples and a run of equal values is never split.
+    // If there are few distinct values, each value has its own bin and no threshold is lost.
+    unsigned char* featureBins = &sampleBins_[static_cast<size_t>(featureIndex)*sampleTotal_];
+    std::vector<double>& featureThresholds = binThresholds_[featureIndex];
+    featureThresholds.clear();
+    int binIndex = 0;
+    for (int i = 0; i < sampleTotal_; ++i) {
+        if (i > 0 && sortedValues[i] != sortedValues[i - 1]) {
+            bool nextBin;
+            if (distinctValueTotal <= binTotal_) nextBin = true;
+            else nextBin = static_cast<long long>(i)*binTotal_ >= static_cast<long long>(binIndex + 1)*sampleTotal_;
+            
+            if (nextBin && binIndex < binTotal_ - 1) {
+                featureThresholds.push_back((sortedValues[i - 1] + sortedValues[i])/2.0);
+                ++binIndex;
+            }
+        }
+        featureBins[sortedIndices[i]] = static_cast<unsigned char>(binIndex);
+    }
+}
+
+void AdaBoost::trainRound() {
+    bool profiling = Profiler::enabled();
+    double roundBeginTime = profiling ? Profiler::now() : 0.0;
+    
+    // Error bounds are only valid for the samples they were computed on, so they are reset with them
+    if (featureErrorBounds_.empty()) featureErrorBounds_.assign(featureTotal_, 0.0);
+    if (gradientTopRate_ > 0) {
+        selectGradientSamples();
+        std::fill(featureErrorBounds_.begin(), featureErrorBounds_.end(), 0.0);
+    } else if (trimmingWeightRate_ > 0 && weakClassifiers_.size()%trimmingRefreshInterval_ == 0) {
+        selectActiveSamples();
+        std::fill(featureErrorBounds_.begin(), featureErrorBounds_.end(), 0.0);
+    }
+    double samplingEndTime = profiling ? Profiler::now() : 0.0;
+    calcWeightSum();
+    double weightSumEndTime = profiling ? Profiler::now() : 0.0;
+    
+    std::vector<int> candidateFeatures;
+    selectCandidateFeatures(candidateFeatures);
+    std::vector<double> candidateErrors(candidateFeatures.size(), -1.0);
+    
+    // With pruning, a feature is skipped only if its bound is larger than the error of a stump already found,
+    // beyond the rounding of the weight sums, so it can't be the best or tie with it.
+    // The features with the smallest bounds are scanned first, so that a good stump is found early.
+    std::atomic<double> incumbentError(HUGE_VAL);
+    double pruningTolerance = (1e-9 + 4*DBL_EPSILON*sampleTotal_)*weightSum_;
+    std::vector<int> leadingCandidateIndices;
+    if (pruning_) selectLeadingCandidates(candidateFeatures, leadingCandidateIndices);
+    
+    // Each thread keeps its own best classifier, which are reduced in thread order afterwards
+    std::vector<DecisionStump> threadBestClassifiers(threadPool_->threadTotal());
+    threadScanBuffers_.resize(threadPool_->threadTotal());
+    ScanCounts zeroCounts = { 0, 0, 0 };
+    std::vector<ScanCounts> threadScanCounts(threadPool_->threadTotal(), zeroCounts);
+    auto scanCandidate = [&](const int candidateIndex, const int threadIndex) {
+        int featureIndex = candidateFeatures[candidateIndex];
+        if (pruning_ && featureErrorBounds_[featureIndex] - pruningTolerance > incumbentError.load()) return;
+        
+        double* errorBound = pruning_ ? &featureErrorBounds_[featureIndex] : NULL;
+        ScanCounts& scanCounts = threadScanCounts[threadIndex];
+        ++scanCounts.featureTotal;
+        DecisionStump optimalClassifier;
+        if (binTotal_ > 0) {
+            optimalClassifier = learnOptimalBinnedClassifier(featureIndex, threadScanBuffers_[threadIndex], errorBound, scanCounts);
+        } else {
+            optimalClassifier = learnOptimalClassifier(featureIndex, threadScanBuffers_[threadIndex], errorBound, scanCounts);
+        }
+        if (optimalClassifier.featureIndex() < 0) return;
+        candidateErrors[candidateIndex] = optimalClassifier.error();
+        
+        if (pruning_) {
+            double currentError = incumbentError.load();
+            while (optimalClassifier.error() < currentError
+                   && !incumbentError.compare_exchange_weak(currentError, optimalClassifier.error())) {}
+        }
+        
+        if (isBetterClassifier(optimalClassifier, threadBestClassifiers[threadIndex])) {
+            threadBestClassifiers[threadIndex] = optimalClassifier;
+        }
+    };
+    // Out of core, the candidates are scanned in blocks of columns which fit in the memory budget.
+    // The next block is read ahead while a block is scanned, and the pages of a scanned block are released,
+    // including those mapped around its columns.
+    auto scanCandidates = [&](const std::vector<int>& candidateIndices) {
+        int candidateTotal = static_cast<int>(candidateIndices.size());
+        std::vector<int> blockEnds;
+        long long blockBytes = 0;
+        for (int position = 0; columnBlockBytes_ > 0 && position < candidateTotal; ++position) {
+            int featureIndex = candidateFeatures[candidateIndices[position]];
+            long long columnBytes = static_cast<long long>(columnOffsets_[featureIndex + 1] - columnOffsets_[featureIndex])
+                                    *(sizeof(int) + sizeof(double));
+            // A column which doesn't follow the previous one begins a new range of the mapped file
+            bool rangeBegin = position == 0 || candidateFeatures[candidateIndices[position - 1]] + 1 != featureIndex;
+            if (position > 0
+                && blockBytes + columnBytes + (rangeBegin ? mappedRangeMarginBytes : 0) > columnBlockBytes_)
+            {
+                blockEnds.push_back(position);
+                blockBytes = 0;
+                rangeBegin = true;
+            }
+            blockBytes += columnBytes + (rangeBegin ? mappedRangeMarginBytes : 0);
+        }
+        if (candidateTotal > 0) blockEnds.push_back(candidateTotal);
+        
+        for (int blockIndex = 0; blockIndex < static_cast<int>(blockEnds.size()); ++blockIndex) {
+            int blockBegin = blockIndex > 0 ? blockEnds[blockIndex - 1] : 0;
+            int blockEnd = blockEnds[blockIndex];
+            if (columnBlockBytes_ > 0) {
+                if (blockIndex == 0) {
+                    adviseCandidateColumns(candidateFeatures, candidateIndices, blockBegin, blockEnd, MappedFile::WillNeed);
+                }
+                if (blockIndex + 1 < static_cast<int>(blockEnds.size())) {
+                    adviseCandidateColumns(candidateFeatures, candidateIndices, blockEnd, blockEnds[blockIndex + 1],
+                                           MappedFile::WillNeed);
+                }
+            }
+            threadPool_->run(blockEnd - blockBegin, [&](const int blockPosition, const int threadIndex) {
+                scanCandidate(candidateIndices[blockBegin + blockPosition], threadIndex);
+            });
+            if (columnBlockBytes_ > 0) {
+                adviseColumns(candidateFeatures[candidateIndices[blockBegin]], candidateFeatures[candidateIndices[blockEnd - 1]] + 1,
+                              MappedFile::DontNeed);
+            }
+        }
+    };
+    auto scanAllCandidates = [&]() {
+        std::vector<int> otherCandidateIndices;
+        otherCandidateIndices.reserve(candidateFeatures.size() - leadingCandidateIndices.size());
+        for (int candidateIndex = 0; candidateIndex < static_cast<int>(candidateFeatures.size()); ++candidateIndex) {
+            if (std::binary_search(leadingCandidateIndices.begin(), leadingCandidateIndices.end(), candidateIndex)) continue;
+            otherCandidateIndices.push_back(candidateIndex);
+        }
+        scanCandidates(leadingCandidateIndices);
+        scanCandidates(otherCandidateIndices);
+        
+        DecisionStump bestClassifier;
+        for (int threadIndex = 0; threadIndex < static_cast<int>(threadBestClassifiers.size()); ++threadIndex) {
+            if (threadBestClassifiers[threadIndex].featureIndex() < 0) continue;
+            
+            if (isBetterClassifier(threadBestClassifiers[threadIndex], bestClassifier)) {
+                bestClassifier = threadBestClassifiers[threadIndex];
+            }
+        }
+        return bestClassifier;
+    };
+    DecisionStump bestClassifier = scanAllCandidates();
+    // Sampled features may give no stump (e.g. if they are all constant), and the round then scans all features
+    if (bestClassifier.featureIndex() < 0 && static_cast<int>(candidateFeatures.size()) < featureTotal_) {
+        candidateFeatures.resize(featureTotal_);
+        for (int featureIndex = 0; featureIndex < featureTotal_; ++featureIndex) candidateFeatures[featureIndex] = featureIndex;
+        candidateErrors.assign(featureTotal_, -1.0);
+        leadingCandidateIndices.clear();
+        if (pruning_) selectLeadingCandidates(candidateFeatures, leadingCandidateIndices);
+        bestClassifier = scanAllCandidates();
+    }
+    if (bestClassifier.featureIndex() < 0) {
+        std::cerr << "error: no stump can be learned from the training samples" << std::endl;
+        exit(1);
+    }
+    if (keptFeatureTotal_ > 0) updateKeptFeatures(candidateFeatures, candidateErrors);
+    double scanEndTime = profiling ? Profiler::now() : 0.0;
+    
+    updateWeight(bestClassifier);
+    addValidationScores(bestClassifier);
+    
+    weakClassifiers_.push_back(bestClassifier);
+    compiled_ = false;
+    cascadeThresholds_.clear();
+    
+    if (profiling) {
+        double updateEndTime = Profiler::now();
+        ScanCounts roundCounts = zeroCounts;
+        for (int threadIndex = 0; threadIndex < static_cast<int>(threadScanCounts.size()); ++threadIndex) {
+            roundCounts.featureTotal += threadScanCounts[threadIndex].featureTotal;
+            roundCounts.thresholdTotal += threadScanCounts[threadIndex].thresholdTotal;
+            roundCounts.sampleTotal += threadScanCounts[threadIndex].sampleTotal;
+        }
+        
+        ProfileRecord record("round");
+        record.addInteger("round", static_cast<long long>(weakClassifiers_.size()) - 1);
+        record.addNumber("sampling_seconds", samplingEndTime - roundBeginTime);
+        record.addNumber("weight_sum_seconds", weightSumEndTime - samplingEndTime);
+        record.addNumber("scan_seconds", scanEndTime - weightSumEndTime);
+        record.addNumber("update_seconds", updateEndTime - scanEndTime);
+        record.addInteger("features_scanned", roundCounts.featureTotal);
+        record.addInteger("thresholds_evaluated", roundCounts.thresholdTotal);
+        record.addInteger("samples_scanned", roundCounts.sampleTotal);
+        record.addInteger("peak_rss_kb", Profiler::peakResidentKilobytes());
+        Profiler::write(record);
     }
 }
 
-double AdaBoost::predict(const std::vector<double>& featureVector) const {
-    double score = 0.0;
-    for (int classifierIndex = 0; classifierIndex < static_cast<int>(weakClassifiers_.size()); ++classifierIndex) {
-        score += weakClassifiers_[classifierIndex].evaluate(featureVector);
+void AdaBoost::selectCandidateFeatures(std::vector<int>& candidateFeatures) const {
+    candidateFeatures.resize(featureTotal_);
+    for (int featureIndex = 0; featureIndex < featureTotal_; ++featureIndex) candidateFeatures[featureIndex] = featureIndex;
+    if (featureSamplingRate_ <= 0 || featureSamplingRate_ >= 1) return;
+    
+    // Partial Fisher-Yates shuffle with a generator seeded by the seed and the round index
+    // (indices are taken directly from the generator, whose sequence is the same on every platform)
+    int sampledFeatureTotal = std::max(static_cast<int>(featureSamplingRate_*featureTotal_ + 0.5), 1);
+    std::seed_seq seedSequence = { randomSeed_, static_cast<unsigned int>(weakClassifiers_.size()) };
+    std::mt19937 generator(seedSequence);
+    for (int sampledIndex = 0; sampledIndex < sampledFeatureTotal; ++sampledIndex) {
+        int swapIndex = sampledIndex + static_cast<int>(generator()%static_cast<unsigned int>(featureTotal_ - sampledIndex));
+        std::swap(candidateFeatures[sampledIndex], candidateFeatures[swapIndex]);
     }
+    candidateFeatures.resize(sampledFeatureTotal);
     
-    return score;
+    // Features in ascending order, so that they are scanned in the same order as without sampling
+    candidateFeatures.insert(candidateFeatures.end(), keptFeatureIndices_.begin(), keptFeatureIndices_.end());
+    std::sort(candidateFeatures.begin(), candidateFeatures.end());
+    candidateFeatures.erase(std::unique(candidateFeatures.begin(), candidateFeatures.end()), candidateFeatures.end());
 }
 
-
-void AdaBoost::initializeWeights() {
-    double initialWeight = 1.0/sampleTotal_;
+void AdaBoost::updateKeptFeatures(const std::vector<int>& candidateFeatures, const std::vector<double>& candidateErrors) {
+    std::vector< std::pair<double, int> > featureErrors;
+    for (int candidateIndex = 0; candidateIndex < static_cast<int>(candidateFeatures.size()); ++candidateIndex) {
+        if (candidateErrors[candidateIndex] < 0) continue;
+        featureErrors.push_back(std::make_pair(candidateErrors[candidateIndex], candidateFeatures[candidateIndex]));
+    }
+    int keptFeatureTotal = std::min(keptFeatureTotal_, static_cast<int>(featureErrors.size()));
+    std::partial_sort(featureErrors.begin(), featureErrors.begin() + keptFeatureTotal, featureErrors.end());
     
-    weights_.resize(sampleTotal_);
-    for (int i = 0; i < sampleTotal_; ++i) weights_[i] = initialWeight;
+    keptFeatureIndices_.resize(keptFeatureTotal);
+    for (int keptIndex = 0; keptIndex < keptFeatureTotal; ++keptIndex) {
+        keptFeatureIndices_[keptIndex] = featureErrors[keptIndex].second;
+    }
 }
 
-void AdaBoost::sortSampleIndices() {
-    sortedSampleIndices_.resize(featureTotal_);
-    for (int d = 0; d < featureTotal_; ++d) {
-        std::vector<SampleElement> featureElements(sampleTotal_);
-        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
-            featureElements[sampleIndex].sampleIndex = sampleIndex;
-            featureElements[sampleIndex].sampleValue = samples_[sampleIndex][d];
+void AdaBoost::selectLeadingCandidates(const std::vector<int>& candidateFeatures,
+                                       std::vector<int>& leadingCandidateIndices) const
+{
+    // One candidate per thread with the smallest bounds; the others keep their order, so that the columns
+    // are still scanned sequentially
+    int leadingCandidateTotal = std::min(threadPool_->threadTotal(), static_cast<int>(candidateFeatures.size()));
+    leadingCandidateIndices.clear();
+    for (int candidateIndex = 0; candidateIndex < static_cast<int>(candidateFeatures.size()); ++candidateIndex) {
+        double errorBound = featureErrorBounds_[candidateFeatures[candidateIndex]];
+        if (static_cast<int>(leadingCandidateIndices.size()) == leadingCandidateTotal) {
+            if (errorBound >= featureErrorBounds_[candidateFeatures[leadingCandidateIndices.back()]]) continue;
+            leadingCandidateIndices.pop_back();
         }
-        std::sort(featureElements.begin(), featureElements.end());
-        
-        sortedSampleIndices_[d].resize(sampleTotal_);
-        for (int i = 0; i < sampleTotal_; ++i) {
-            sortedSampleIndices_[d][i] = featureElements[i].sampleIndex;
+        int insertIndex = static_cast<int>(leadingCandidateIndices.size());
+        while (insertIndex > 0 && errorBound < featureErrorBounds_[candidateFeatures[leadingCandidateIndices[insertIndex - 1]]]) {
+            --insertIndex;
         }
+        leadingCandidateIndices.insert(leadingCandidateIndices.begin() + insertIndex, candidateIndex);
     }
+    std::sort(leadingCandidateIndices.begin(), leadingCandidateIndices.end());
 }
 
-void AdaBoost::trainRound() {
-    calcWeightSum();
+void AdaBoost::selectActiveSamples() {
+    activeSampleFlags_.clear();
+    activeSampleIndices_.clear();
+    activeColumnOffsets_.clear();
+    activeFeatureValues_.clear();
+    activeColumnSampleIndices_.clear();
     
-    DecisionStump bestClassifier;
-    for (int featureIndex = 0; featureIndex < featureTotal_; ++featureIndex) {
-        DecisionStump optimalClassifier = learnOptimalClassifier(featureIndex);
-        if (optimalClassifier.featureIndex() < 0) continue;
-        
-        if (bestClassifier.error() < 0 || optimalClassifier.error() < bestClassifier.error()) {
-            bestClassifier = optimalClassifier;
+    // Smallest weight among the largest weights which hold trimmingWeightRate_ of the total weight
+    std::vector<double> sortedWeights(weights_);
+    std::sort(sortedWeights.begin(), sortedWeights.end(), std::greater<double>());
+    double weightTotal = 0.0;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) weightTotal += sortedWeights[sampleIndex];
+    double minActiveWeight = sortedWeights[sampleTotal_ - 1];
+    double activeWeightSum = 0.0;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        activeWeightSum += sortedWeights[sampleIndex];
+        if (activeWeightSum >= trimmingWeightRate_*weightTotal) {
+            minActiveWeight = sortedWeights[sampleIndex];
+            break;
         }
     }
     
-    updateWeight(bestClassifier);
+    std::vector<int> activeSampleIndices;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        if (weights_[sampleIndex] >= minActiveWeight) activeSampleIndices.push_back(sampleIndex);
+    }
+    if (static_cast<long long>(activeSampleIndices.size())*2 > sampleTotal_) return;
     
-    weakClassifiers_.push_back(bestClassifier);
+    activeSampleIndices_.swap(activeSampleIndices);
+    activeSampleFlags_.assign(sampleTotal_, 0);
+    for (int activeIndex = 0; activeIndex < static_cast<int>(activeSampleIndices_.size()); ++activeIndex) {
+        activeSampleFlags_[activeSampleIndices_[activeIndex]] = 1;
+    }
+    if (binTotal_ > 0) return;
+    
+    // Active entries of the sorted columns
+    std::vector<size_t> activeLengths(featureTotal_);
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        activeLengths[d] = gatherActiveColumn(d, NULL, NULL);
+    });
+    activeColumnOffsets_.resize(featureTotal_ + 1);
+    activeColumnOffsets_[0] = 0;
+    for (int d = 0; d < featureTotal_; ++d) activeColumnOffsets_[d + 1] = activeColumnOffsets_[d] + activeLengths[d];
+    activeFeatureValues_.resize(activeColumnOffsets_[featureTotal_]);
+    activeColumnSampleIndices_.resize(activeColumnOffsets_[featureTotal_]);
+    threadPool_->run(featureTotal_, [&](const int d, const int) {
+        gatherActiveColumn(d, activeFeatureValues_.data() + activeColumnOffsets_[d],
+                           activeColumnSampleIndices_.data() + activeColumnOffsets_[d]);
+    });
+}
+
+void AdaBoost::selectGradientSamples() {
+    activeSampleFlags_.assign(sampleTotal_, 0);
+    activeSampleIndices_.clear();
+    
+    // Weight of the last top sample; samples of equal weight are taken in index order
+    int topSampleTotal = std::min(static_cast<int>(gradientTopRate_*sampleTotal_ + 0.5), sampleTotal_);
+    std::vector<int> otherSampleIndices;
+    otherSampleIndices.reserve(sampleTotal_ - topSampleTotal);
+    if (topSampleTotal > 0) {
+        std::vector<double> sortedWeights(weights_);
+        std::nth_element(sortedWeights.begin(), sortedWeights.begin() + topSampleTotal - 1, sortedWeights.end(),
+                         std::greater<double>());
+        double minTopWeight = sortedWeights[topSampleTotal - 1];
+        int equalTopTotal = topSampleTotal;
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            if (weights_[sampleIndex] > minTopWeight) --equalTopTotal;
+        }
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            if (weights_[sampleIndex] > minTopWeight) {
+                activeSampleFlags_[sampleIndex] = 1;
+            } else if (weights_[sampleIndex] == minTopWeight && equalTopTotal > 0) {
+                activeSampleFlags_[sampleIndex] = 1;
+                --equalTopTotal;
+            } else {
+                otherSampleIndices.push_back(sampleIndex);
+            }
+        }
+    } else {
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) otherSampleIndices.push_back(sampleIndex);
+    }
+    
+    // Random samples from the others, drawn from the seed and the round index
+    int otherTotal = static_cast<int>(otherSampleIndices.size());
+    int drawTotal = std::min(static_cast<int>(gradientOtherRate_*sampleTotal_ + 0.5), otherTotal);
+    std::seed_seq seedSequence = { randomSeed_, static_cast<unsigned int>(weakClassifiers_.size()), 1u };
+    std::mt19937 generator(seedSequence);
+    for (int drawIndex = 0; drawIndex < drawTotal; ++drawIndex) {
+        int swapIndex = drawIndex + static_cast<int>(generator()%static_cast<unsigned int>(otherTotal - drawIndex));
+        std::swap(otherSampleIndices[drawIndex], otherSampleIndices[swapIndex]);
+        activeSampleFlags_[otherSampleIndices[drawIndex]] = scaledSampleFlag;
+    }
+    sampledWeightScale_ = (drawTotal > 0) ? (1.0 - gradientTopRate_)/gradientOtherRate_ : 1.0;
+    
+    // Active samples in ascending order for the histograms
+    activeSampleIndices_.reserve(topSampleTotal + drawTotal);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+        if (activeSampleFlags_[sampleIndex]) activeSampleIndices_.push_back(sampleIndex);
+    }
+}
+
+size_t AdaBoost::gatherActiveColumn(const int featureIndex, double* activeValues, int* activeIndices) const {
+    size_t columnBegin = columnOffsets_[featureIndex];
+    size_t columnLength = columnOffsets_[featureIndex + 1] - columnBegin;
+    if (!compactStorage_) {
+        return gatherActiveEntries(sortedFeatureValues_.data() + columnBegin, sortedSampleIndices_.data() + columnBegin,
+                                   columnLength, activeSampleFlags_, activeValues, activeIndices);
+    }
+    if (hasCompactSampleIndices()) {
+        return gatherActiveEntries(compactFeatureValues_.data() + columnBegin, compactSampleIndices_.data() + columnBegin,
+                                   columnLength, activeSampleFlags_, activeValues, activeIndices);
+    }
+    return gatherActiveEntries(compactFeatureValues_.data() + columnBegin, sortedSampleIndices_.data() + columnBegin,
+                               columnLength, activeSampleFlags_, activeValues, activeIndices);
 }
 
 void AdaBoost::calcWeightSum() {
+    labelWeights_.resize(sampleTotal_);
+    
+    int blockTotal = (sampleTotal_ + sampleBlockSize - 1)/sampleBlockSize;
+    std::vector<double> blockWeightSums(blockTotal, 0.0);
+    std::vector<double> blockWeightLabelSums(blockTotal, 0.0);
+    std::vector<double> blockPositiveWeightSums(blockTotal, 0.0);
+    std::vector<double> blockNegativeWeightSums(blockTotal, 0.0);
+    
+    threadPool_->run(blockTotal, [&](const int blockIndex, const int) {
+        int sampleBegin = blockIndex*sampleBlockSize;
+        int sampleEnd = std::min(sampleBegin + sampleBlockSize, sampleTotal_);
+        
+        double weightSum = 0;
+        double weightLabelSum = 0;
+        double positiveWeightSum = 0;
+        double negativeWeightSum = 0;
+        for (int sampleIndex = sampleBegin; sampleIndex < sampleEnd; ++sampleIndex) {
+            double weight = weights_[sampleIndex];
+            if (!activeSampleFlags_.empty()) {
+                if (!activeSampleFlags_[sampleIndex]) {
+                    labelWeights_[sampleIndex] = 0.0;
+                    continue;
+                }
+                if (activeSampleFlags_[sampleIndex] == scaledSampleFlag) weight *= sampledWeightScale_;
+            }
+            
+            weightSum += weight;
+            if (labels_[sampleIndex] > 0) {
+                weightLabelSum += weight;
+                positiveWeightSum += weight;
+                labelWeights_[sampleIndex] = weight;
+            } else {
+                weightLabelSum -= weight;
+                negativeWeightSum += weight;
+                labelWeights_[sampleIndex] = -weight;
+            }
+        }
+        
+        blockWeightSums[blockIndex] = weightSum;
+        blockWeightLabelSums[blockIndex] = weightLabelSum;
+        blockPositiveWeightSums[blockIndex] = positiveWeightSum;
+        blockNegativeWeightSums[blockIndex] = negativeWeightSum;
+    });
+    
     weightSum_ = 0;
     weightLabelSum_ = 0;
     positiveWeightSum_ = 0;
     negativeWeightSum_ = 0;
+    for (int blockIndex = 0; blockIndex < blockTotal; ++blockIndex) {
+        weightSum_ += blockWeightSums[blockIndex];
+        weightLabelSum_ += blockWeightLabelSums[blockIndex];
+        positiveWeightSum_ += blockPositiveWeightSums[blockIndex];
+        negativeWeightSum_ += blockNegativeWeightSums[blockIndex];
+    }
+}
 
-    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
-        weightSum_ += weights_[sampleIndex];
-        if (labels_[sampleIndex]) {
-            weightLabelSum_ += weights_[sampleIndex];
-            positiveWeightSum_ += weights_[sampleIndex];
-        } else {
-            weightLabelSum_ -= weights_[sampleIndex];
-            negativeWeightSum_ += weights_[sampleIndex];
-        }
+AdaBoost::DecisionStump AdaBoost::learnOptimalClassifier(const int featureIndex,
+                                                         std::vector<double>& sortedLabelWeights,
+                                                         double* errorBound,
+                                                         ScanCounts& scanCounts)
+{
+    if (!activeSampleFlags_.empty()) {
+        size_t activeBegin = activeColumnOffsets_[featureIndex];
+        int activeLength = static_cast<int>(activeColumnOffsets_[featureIndex + 1] - activeBegin);
+        return learnOptimalSortedClassifier(featureIndex, activeFeatureValues_.data() + activeBegin,
+                                            activeColumnSampleIndices_.data() + activeBegin, NULL, activeLength,
+                                            static_cast<int>(activeSampleIndices_.size()), sortedLabelWeights,
+                                            errorBound, scanCounts);
     }
+    
+    size_t columnBegin = columnOffsets_[featureIndex];
+    int columnLength = static_cast<int>(columnOffsets_[featureIndex + 1] - columnBegin);
+    const int* runEnds = NULL;
+    if (!runOffsets_.empty() && runOffsets_[featureIndex + 1] > runOffsets_[featureIndex]) {
+        runEnds = sortedRunEnds_.data() + runOffsets_[featureIndex];
+    }
+    if (!compactStorage_) {
+        return learnOptimalSortedClassifier(featureIndex, sortedFeatureValues_.data() + columnBegin,
+                                            sortedSampleIndices_.data() + columnBegin, runEnds, columnLength, sampleTotal_,
+                                            sortedLabelWeights, errorBound, scanCounts);
+    }
+    if (hasCompactSampleIndices()) {
+        return learnOptimalSortedClassifier(featureIndex, compactFeatureValues_.data() + columnBegin,
+                                            compactSampleIndices_.data() + columnBegin, runEnds, columnLength, sampleTotal_,
+                                            sortedLabelWeights, errorBound, scanCounts);
+    }
+    return learnOptimalSortedClassifier(featureIndex, compactFeatureValues_.data() + columnBegin,
+                                        sortedSampleIndices_.data() + columnBegin, runEnds, columnLength, sampleTotal_,
+                                        sortedLabelWeights, errorBound, scanCounts);
 }
 
-AdaBoost::DecisionStump AdaBoost::learnOptimalClassifier(const int featureIndex) {
+template <typename ValueType, typename IndexType>
+AdaBoost::DecisionStump AdaBoost::learnOptimalSortedClassifier(const int featureIndex,
+                                                               const ValueType* sortedValues,
+                                                               const IndexType* sortedIndices,
+                                                               const int* runEnds,
+                                                               const int columnLength,
+                                                               const int columnSampleTotal,
+                                                               std::vector<double>& sortedLabelWeights,
+                                                               double* errorBound,
+                                                               ScanCounts& scanCounts)
+{
     const double epsilonValue = 1e-6;
     
+    
+    // Gather label-weights into sorted order, so that the scan below only reads contiguous arrays
+    sortedLabelWeights.resize(columnLength);
+    for (int sortIndex = 0; sortIndex < columnLength; ++sortIndex) {
+        sortedLabelWeights[sortIndex] = labelWeights_[sortedIndices[sortIndex]];
+    }
+    
+    // Samples which aren't stored in a sparse column have zero value. They are handled as one block
+    // between negative and positive values, whose sums are the rest of the total sums.
+    int zeroValueTotal = columnSampleTotal - columnLength;
+    double zeroWeightSum = weightSum_;
+    double zeroWeightLabelSum = weightLabelSum_;
+    double zeroPositiveWeightSum = positiveWeightSum_;
+    double zeroNegativeWeightSum = negativeWeightSum_;
+    if (zeroValueTotal > 0) {
+        for (int sortIndex = 0; sortIndex < columnLength; ++sortIndex) {
+            subtractLabelWeight(sortedLabelWeights[sortIndex],
+                                zeroWeightSum, zeroWeightLabelSum, zeroPositiveWeightSum, zeroNegativeWeightSum);
+        }
+    }
+    bool zeroBlockPassed = (zeroValueTotal == 0);
+    
     double weightSumLarger = weightSum_;
     double weightLabelSumLarger = weightLabelSum_;
     double positiveWeightSumLarger = positiveWeightSum_;
     double negativeWeightSumLarger = negativeWeightSum_;
     
     DecisionStump optimalClassifier;
-    for (int sortIndex = 0; sortIndex < sampleTotal_ - 1; ++sortIndex) {
-        int sampleIndex = sortedSampleIndices_[featureIndex][sortIndex];
-        double threshold = samples_[sampleIndex][featureIndex];
-        
-        double sampleWeight = weights_[sampleIndex];
-        weightSumLarger -= sampleWeight;
-        if (labels_[sampleIndex]) {
-            weightLabelSumLarger -= sampleWeight;
-            positiveWeightSumLarger -= sampleWeight;
+    double minErrorBound = HUGE_VAL;
+    long long thresholdTotal = 0;
+    int sortIndex = 0;
+    int runIndex = 0;
+    while (true) {
+        ValueType threshold;
+        if (!zeroBlockPassed && (sortIndex >= columnLength || sortedValues[sortIndex] > 0)) {
+            threshold = 0;
+            weightSumLarger -= zeroWeightSum;
+            weightLabelSumLarger -= zeroWeightLabelSum;
+            positiveWeightSumLarger -= zeroPositiveWeightSum;
+            negativeWeightSumLarger -= zeroNegativeWeightSum;
+            zeroBlockPassed = true;
         } else {
-            weightLabelSumLarger += sampleWeight;
-            negativeWeightSumLarger -= sampleWeight;
-        }
-        
-        while (sortIndex < sampleTotal_ - 1
-               && samples_[sampleIndex][featureIndex] == samples_[sortedSampleIndices_[featureIndex][sortIndex + 1]][featureIndex])
-        {
-            ++sortIndex;
-            sampleIndex = sortedSampleIndices_[featureIndex][sortIndex];
-            sampleWeight = weights_[sampleIndex];
-            weightSumLarger -= sampleWeight;
-            if (labels_[sampleIndex]) {
-                weightLabelSumLarger -= sampleWeight;
-                positiveWeightSumLarger -= sampleWeight;
+            // All samples with the value of the threshold move to the smaller side
+            threshold = sortedValues[sortIndex];
+            int runEnd = sortIndex + 1;
+            if (runEnds != NULL) {
+                runEnd = runEnds[runIndex];
+                ++runIndex;
             } else {
-                weightLabelSumLarger += sampleWeight;
-                negativeWeightSumLarger -= sampleWeight;
+                while (runEnd < columnLength && sortedValues[runEnd] == threshold) ++runEnd;
+            }
+            for (; sortIndex < runEnd; ++sortIndex) {
+                subtractLabelWeight(sortedLabelWeights[sortIndex],
+                                    weightSumLarger, weightLabelSumLarger, positiveWeightSumLarger, negativeWeightSumLarger);
             }
         }
-        if (sortIndex >= sampleTotal_ - 1) break;
         
-        if (fabs(weightSumLarger) < epsilonValue || fabs(weightSum_ - weightSumLarger) < epsilonValue) continue;
+        ValueType nextValue;
+        if (!zeroBlockPassed && (sortIndex >= columnLength || sortedValues[sortIndex] > 0)) nextValue = 0;
+        else if (sortIndex < columnLength) nextValue = sortedValues[sortIndex];
+        else break;
+        
+        // The bound includes skipped splits, which may be valid with later weights. The error of a valid
+        // gentle split is its bound, so it is taken from the optimal classifier.
+        bool validSplit = fabs(weightSumLarger) >= epsilonValue && fabs(weightSum_ - weightSumLarger) >= epsilonValue;
+        if (errorBound != NULL && (!validSplit || boostingType_ != 2)) {
+            minErrorBound = std::min(minErrorBound, computeErrorBound(positiveWeightSumLarger, negativeWeightSumLarger));
+        }
+        if (!validSplit) continue;
         
-        double outputLarger, outputSmaller;
-        computeClassifierOutputs(weightSumLarger, weightLabelSumLarger, positiveWeightSumLarger, negativeWeightSumLarger,
-                                 outputLarger, outputSmaller);
+        ++thresholdTotal;
+        updateOptimalClassifier(featureIndex, (static_cast<double>(threshold) + nextValue)/2.0,
+                                weightSumLarger, weightLabelSumLarger, positiveWeightSumLarger, negativeWeightSumLarger,
+                                optimalClassifier);
+    }
+    if (errorBound != NULL) {
+        if (boostingType_ == 2 && optimalClassifier.featureIndex() >= 0) {
+            minErrorBound = std::min(minErrorBound, optimalClassifier.error());
+        }
+        *errorBound = minErrorBound;
+    }
+    scanCounts.thresholdTotal += thresholdTotal;
+    scanCounts.sampleTotal += columnLength;
+    
+    return optimalClassifier;
+}
+
+AdaBoost::DecisionStump AdaBoost::learnOptimalBinnedClassifier(const int featureIndex,
+                                                               std::vector<double>& binWeightSums,
+                                                               double* errorBound,
+                                                               ScanCounts& scanCounts)
+{
+    int featureBinTotal = static_cast<int>(binThresholds_[featureIndex].size()) + 1;
+    binWeightSums.resize(2*featureBinTotal);
+    accumulateBinWeightSums(featureIndex, &binWeightSums[0], &binWeightSums[featureBinTotal]);
+    scanCounts.sampleTotal += activeSampleFlags_.empty() ? sampleTotal_ : static_cast<int>(activeSampleIndices_.size());
+    
+    return scanBinWeightSums(featureIndex, &binWeightSums[0], &binWeightSums[featureBinTotal], errorBound, scanCounts);
+}
+
+void AdaBoost::accumulateBinWeightSums(const int featureIndex,
+                                       double* positiveBinWeightSums,
+                                       double* negativeBinWeightSums) const
+{
+    int featureBinTotal = static_cast<int>(binThresholds_[featureIndex].size()) + 1;
+    std::fill(positiveBinWeightSums, positiveBinWeightSums + featureBinTotal, 0.0);
+    std::fill(negativeBinWeightSums, negativeBinWeightSums + featureBinTotal, 0.0);
+    
+    const unsigned char* featureBins = &sampleBins_[static_cast<size_t>(featureIndex)*sampleTotal_];
+    int activeTotal = activeSampleFlags_.empty() ? sampleTotal_ : static_cast<int>(activeSampleIndices_.size());
+    for (int activeIndex = 0; activeIndex < activeTotal; ++activeIndex) {
+        int sampleIndex = activeSampleFlags_.empty() ? activeIndex : activeSampleIndices_[activeIndex];
+        double labelWeight = labelWeights_[sampleIndex];
+        positiveBinWeightSums[featureBins[sampleIndex]] += (labelWeight > 0 ? labelWeight : 0.0);
+        negativeBinWeightSums[featureBins[sampleIndex]] += (labelWeight < 0 ? -labelWeight : 0.0);
+    }
+}
+
+AdaBoost::DecisionStump AdaBoost::scanBinWeightSums(const int featureIndex,
+                                                    const double* positiveBinWeightSums,
+                                                    const double* negativeBinWeightSums,
+                                                    double* errorBound,
+                                                    ScanCounts& scanCounts) const
+{
+    const double epsilonValue = 1e-6;
+    
+    const std::vector<double>& featureThresholds = binThresholds_[featureIndex];
+    int featureBinTotal = static_cast<int>(featureThresholds.size()) + 1;
+    
+    double weightSumLarger = weightSum_;
+    double weightLabelSumLarger = weightLabelSum_;
+    double positiveWeightSumLarger = positiveWeightSum_;
+    double negativeWeightSumLarger = negativeWeightSum_;
+    
+    DecisionStump optimalClassifier;
+    double minErrorBound = HUGE_VAL;
+    long long thresholdTotal = 0;
+    for (int binIndex = 0; binIndex < featureBinTotal - 1; ++binIndex) {
+        weightSumLarger -= positiveBinWeightSums[binIndex] + negativeBinWeightSums[binIndex];
+        weightLabelSumLarger -= positiveBinWeightSums[binIndex] - negativeBinWeightSums[binIndex];
+        positiveWeightSumLarger -= positiveBinWeightSums[binIndex];
+        negativeWeightSumLarger -= negativeBinWeightSums[binIndex];
         
-        double error = computeError(positiveWeightSumLarger, negativeWeightSumLarger, outputLarger, outputSmaller);
+        bool validSplit = fabs(weightSumLarger) >= epsilonValue && fabs(weightSum_ - weightSumLarger) >= epsilonValue;
+        if (errorBound != NULL && (!validSplit || boostingType_ != 2)) {
+            minErrorBound = std::min(minErrorBound, computeErrorBound(positiveWeightSumLarger, negativeWeightSumLarger));
+        }
+        if (!validSplit) continue;
         
-        if (optimalClassifier.error() < 0 || error < optimalClassifier.error()) {
-            double classifierThreshold = (threshold + samples_[sortedSampleIndices_[featureIndex][sortIndex + 1]][featureIndex])/2.0;
-            
-            if (boostingType_ == 0) {
-                double classifierWeight = log((1.0 - error)/error)/2.0;
-                outputLarger *= classifierWeight;
-                outputSmaller *= classifierWeight;
-            }
-            
-            optimalClassifier.set(featureIndex, classifierThreshold, outputLarger, outputSmaller, error);
+        ++thresholdTotal;
+        updateOptimalClassifier(featureIndex, featureThresholds[binIndex],
+                                weightSumLarger, weightLabelSumLarger, positiveWeightSumLarger, negativeWeightSumLarger,
+                                optimalClassifier);
+    }
+    if (errorBound != NULL) {
+        if (boostingType_ == 2 && optimalClassifier.featureIndex() >= 0) {
+            minErrorBound = std::min(minErrorBound, optimalClassifier.error());
         }
+        *errorBound = minErrorBound;
     }
+    scanCounts.thresholdTotal += thresholdTotal;
     
     return optimalClassifier;
 }
 
+void AdaBoost::updateOptimalClassifier(const int featureIndex,
+                                       const double threshold,
+                                       const double weightSumLarger,
+                                       const double weightLabelSumLarger,
+                                       const double positiveWeightSumLarger,
+                                       const double negativeWeightSumLarger,
+                                       DecisionStump& optimalClassifier) const
+{
+    double outputLarger, outputSmaller;
+    computeClassifierOutputs(weightSumLarger, weightLabelSumLarger, positiveWeightSumLarger, negativeWeightSumLarger,
+                             outputLarger, outputSmaller);
+    
+    double error = computeError(positiveWeightSumLarger, negativeWeightSumLarger, outputLarger, outputSmaller);
+    
+    if (optimalClassifier.error() < 0 || error < optimalClassifier.error()) {
+        if (boostingType_ == 0) {
+            double classifierWeight = log((1.0 - error)/error)/2.0;
+            outputLarger *= classifierWeight;
+            outputSmaller *= classifierWeight;
+        }
+        
+        optimalClassifier.set(featureIndex, threshold, outputLarger, outputSmaller, error);
+    }
+}
+
 void AdaBoost::computeClassifierOutputs(const double weightSumLarger,
                                         const double weightLabelSumLarger,
                                         const double positiveWeightSumLarger,
@@ -319,21 +2548,174 @@ double AdaBoost::computeError(const double positiveWeightSumLarger,
     return error;
 }
 
-void AdaBoost::updateWeight(const AdaBoost::DecisionStump& bestClassifier) {
-    double updatedWeightSum = 0.0;
-    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
-        int labelInteger;
-        if (labels_[sampleIndex]) labelInteger = 1;
-        else labelInteger = -1;
-        weights_[sampleIndex] *= exp(-1.0*labelInteger*bestClassifier.evaluate(samples_[sampleIndex]));
-        updatedWeightSum += weights_[sampleIndex];
+double AdaBoost::computeErrorBound(const double positiveWeightSumLarger, const double negativeWeightSumLarger) const {
+    // Smallest error of the split over all outputs; it is positively homogeneous and nondecreasing in the weights
+    double positiveWeightSumSmaller = std::max(positiveWeightSum_ - positiveWeightSumLarger, 0.0);
+    double negativeWeightSumSmaller = std::max(negativeWeightSum_ - negativeWeightSumLarger, 0.0);
+    double positiveLarger = std::max(positiveWeightSumLarger, 0.0);
+    double negativeLarger = std::max(negativeWeightSumLarger, 0.0);
+    
+    if (boostingType_ == 0) {
+        // Discrete AdaBoost: one of the two opposite labelings
+        return std::min(positiveLarger + negativeWeightSumSmaller, negativeLarger + positiveWeightSumSmaller);
+    } else if (boostingType_ == 1) {
+        // Real AdaBoost: P*exp(-o) + N*exp(o) >= 2*sqrt(P*N)
+        return 2.0*(sqrt(positiveLarger*negativeLarger) + sqrt(positiveWeightSumSmaller*negativeWeightSumSmaller));
+    } else {
+        // Gentle AdaBoost: P*(1 - o)^2 + N*(1 + o)^2 >= 4*P*N/(P + N)
+        double errorBound = 0.0;
+        if (positiveLarger + negativeLarger > 0) {
+            errorBound += 4.0*positiveLarger*negativeLarger/(positiveLarger + negativeLarger);
+        }
+        if (positiveWeightSumSmaller + negativeWeightSumSmaller > 0) {
+            errorBound += 4.0*positiveWeightSumSmaller*negativeWeightSumSmaller/(positiveWeightSumSmaller + negativeWeightSumSmaller);
+        }
+        return errorBound;
     }
+}
+
+bool AdaBoost::isBetterClassifier(const DecisionStump& candidateClassifier, const DecisionStump& currentClassifier) const {
+    if (currentClassifier.error() < 0 || candidateClassifier.error() < currentClassifier.error()) return true;
     
-    for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
-        weights_[sampleIndex] /= updatedWeightSum;
+    // Ties are broken by feature index to give the same result as a serial scan
+    return candidateClassifier.error() == currentClassifier.error()
+           && candidateClassifier.featureIndex() < currentClassifier.featureIndex();
+}
+
+void AdaBoost::evaluateTrainingSamples(const DecisionStump& classifier, std::vector<double>& outputs) const {
+    outputs.resize(sampleTotal_);
+    
+    if (binTotal_ > 0) {
+        // A sample is on the larger side if its bin is above the bin boundary of the threshold
+        const std::vector<double>& featureThresholds = binThresholds_[classifier.featureIndex()];
+        int splitBinIndex = static_cast<int>(std::lower_bound(featureThresholds.begin(), featureThresholds.end(),
+                                                              classifier.threshold()) - featureThresholds.begin());
+        const unsigned char* featureBins = &sampleBins_[static_cast<size_t>(classifier.featureIndex())*sampleTotal_];
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) {
+            if (featureBins[sampleIndex] > splitBinIndex) outputs[sampleIndex] = classifier.outputLarger();
+            else outputs[sampleIndex] = classifier.outputSmaller();
+        }
+        return;
     }
+    
+    size_t columnBegin = columnOffsets_[classifier.featureIndex()];
+    if (!compactStorage_) {
+        evaluateSortedColumn(classifier, sortedFeatureValues_.data() + columnBegin,
+                             sortedSampleIndices_.data() + columnBegin, outputs);
+        if (columnBlockBytes_ > 0) adviseColumns(0, featureTotal_, MappedFile::DontNeed);
+    } else if (hasCompactSampleIndices()) {
+        evaluateSortedColumn(classifier, compactFeatureValues_.data() + columnBegin,
+                             compactSampleIndices_.data() + columnBegin, outputs);
+    } else {
+        evaluateSortedColumn(classifier, compactFeatureValues_.data() + columnBegin,
+                             sortedSampleIndices_.data() + columnBegin, outputs);
+    }
+}
+
+template <typename ValueType, typename IndexType>
+void AdaBoost::evaluateSortedColumn(const DecisionStump& classifier,
+                                    const ValueType* sortedValues,
+                                    const IndexType* sortedIndices,
+                                    std::vector<double>& outputs) const
+{
+    int columnLength = static_cast<int>(columnOffsets_[classifier.featureIndex() + 1] - columnOffsets_[classifier.featureIndex()]);
+    if (columnLength < sampleTotal_) {
+        double zeroOutput = classifier.evaluate(0.0);
+        for (int sampleIndex = 0; sampleIndex < sampleTotal_; ++sampleIndex) outputs[sampleIndex] = zeroOutput;
+    }
+    
+    int blockTotal = (columnLength + sampleBlockSize - 1)/sampleBlockSize;
+    threadPool_->run(blockTotal, [&](const int blockIndex, const int) {
+        int sortBegin = blockIndex*sampleBlockSize;
+        int sortEnd = std::min(sortBegin + sampleBlockSize, columnLength);
+        for (int sortIndex = sortBegin; sortIndex < sortEnd; ++sortIndex) {
+            outputs[sortedIndices[sortIndex]] = classifier.evaluate(sortedValues[sortIndex]);
+        }
+    });
+}
+
+bool AdaBoost::hasCompactSampleIndices() const {
+    return compactStorage_ && sampleTotal_ <= maxCompactIndexSampleTotal;
+}
+
+double AdaBoost::updateWeight(const AdaBoost::DecisionStump& bestClassifier) {
+    evaluateTrainingSamples(bestClassifier, classifierOutputs_);
+    
+    int blockTotal = (sampleTotal_ + sampleBlockSize - 1)/sampleBlockSize;
+    std::vector<double> blockWeightSums(blockTotal, 0.0);
+    // With pruning, weights before the update are also summed by label and side of the stump
+    std::vector<double> blockGroupWeightSums(pruning_ ? 4*blockTotal : 0, 0.0);
+    
+    threadPool_->run(blockTotal, [&](const int blockIndex, const int) {
+        int sampleBegin = blockIndex*sampleBlockSize;
+        int sampleEnd = std::min(sampleBegin + sampleBlockSize, sampleTotal_);
+        
+        if (pruning_) {
+            for (int sampleIndex = sampleBegin; sampleIndex < sampleEnd; ++sampleIndex) {
+                int groupIndex = (labels_[sampleIndex] > 0 ? 1 : 0)
+                                 + (classifierOutputs_[sampleIndex] == bestClassifier.outputLarger() ? 2 : 0);
+                blockGroupWeightSums[4*blockIndex + groupIndex] += weights_[sampleIndex];
+            }
+        }
+        
+        double weightSum = 0.0;
+        for (int sampleIndex = sampleBegin; sampleIndex < sampleEnd; ++sampleIndex) {
+            weights_[sampleIndex] *= exp(-1.0*labels_[sampleIndex]*classifierOutputs_[sampleIndex]);
+            weightSum += weights_[sampleIndex];
+            trainingScores_[sampleIndex] += classifierOutputs_[sampleIndex];
+        }
+        blockWeightSums[blockIndex] = weightSum;
+    });
+    
+    double updatedWeightSum = 0.0;
+    for (int blockIndex = 0; blockIndex < blockTotal; ++blockIndex) updatedWeightSum += blockWeightSums[blockIndex];
+    
+    if (pruning_) updateErrorBounds(bestClassifier, blockGroupWeightSums, updatedWeightSum);
+    
+    threadPool_->run(blockTotal, [&](const int blockIndex, const int) {
+        int sampleBegin = blockIndex*sampleBlockSize;
+        int sampleEnd = std::min(sampleBegin + sampleBlockSize, sampleTotal_);
+        for (int sampleIndex = sampleBegin; sampleIndex < sampleEnd; ++sampleIndex) {
+            weights_[sampleIndex] /= updatedWeightSum;
+        }
+    });
+    
+    return updatedWeightSum;
 }
 
+void AdaBoost::updateErrorBounds(const DecisionStump& bestClassifier,
+                                 const std::vector<double>& blockGroupWeightSums,
+                                 const double updatedWeightSum)
+{
+    // Weights of a group (negative/positive, smaller/larger side) are all multiplied by the same factor
+    double groupWeightSums[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (size_t blockGroupIndex = 0; blockGroupIndex < blockGroupWeightSums.size(); ++blockGroupIndex) {
+        groupWeightSums[blockGroupIndex%4] += blockGroupWeightSums[blockGroupIndex];
+    }
+    double groupOutputs[4] = { -bestClassifier.outputSmaller(), bestClassifier.outputSmaller(),
+                               -bestClassifier.outputLarger(), bestClassifier.outputLarger() };
+    double minMultiplier = HUGE_VAL;
+    double decreasedWeightSum = 0.0;
+    for (int groupIndex = 0; groupIndex < 4; ++groupIndex) {
+        if (groupWeightSums[groupIndex] <= 0) continue;
+        double multiplier = exp(-groupOutputs[groupIndex])/updatedWeightSum;
+        minMultiplier = std::min(minMultiplier, multiplier);
+        if (multiplier < 1.0) decreasedWeightSum += groupWeightSums[groupIndex]*(1.0 - multiplier);
+    }
+    
+    // Bounds are nondecreasing and positively homogeneous in the weights, so they are at least multiplied by the
+    // smallest factor. Bounds of discrete and gentle AdaBoost also decrease by at most 1 and 4 times the decreased
+    // weight, which is much tighter when the stump changes only a few weights.
+    double lipschitzConstant = (boostingType_ == 0) ? 1.0 : 4.0;
+    for (int featureIndex = 0; featureIndex < featureTotal_; ++featureIndex) {
+        double errorBound = featureErrorBounds_[featureIndex];
+        featureErrorBounds_[featureIndex] = errorBound*minMultiplier;
+        if (boostingType_ != 1) {
+            featureErrorBounds_[featureIndex] = std::max(featureErrorBounds_[featureIndex],
+                                                         errorBound - lipschitzConstant*decreasedWeightSum);
+        }
+    }
+}
 
 void AdaBoost::writeFile(const std::string filename) const {
     std::ofstream outputModelStream(filename.c_str(), std::ios_base::out);
@@ -344,6 +2726,9 @@ void AdaBoost::writeFile(const std::string filename) const {
     
     int roundTotal = static_cast<int>(weakClassifiers_.size());
     outputModelStream << roundTotal << std::endl;
+    // Stumps are written exactly, so that partial sums at prediction are the same as those cascade thresholds
+    // were calibrated on, and a model continued by setInitialModel rebuilds the same weights
+    outputModelStream << std::setprecision(17);
     for (int roundIndex = 0; roundIndex < roundTotal; ++roundIndex) {
         outputModelStream << weakClassifiers_[roundIndex].featureIndex() << " ";
         outputModelStream << weakClassifiers_[roundIndex].threshold() << " ";
@@ -351,19 +2736,212 @@ void AdaBoost::writeFile(const std::string filename) const {
         outputModelStream << weakClassifiers_[roundIndex].outputSmaller() << std::endl;
     }
     
+    // Cascade thresholds follow the stumps, so that readers which don't know them ignore them
+    if (!cascadeThresholds_.empty()) {
+        outputModelStream << "cascade" << std::endl;
+        for (int roundIndex = 0; roundIndex < roundTotal; ++roundIndex) {
+            outputModelStream << cascadeThresholds_[roundIndex] << std::endl;
+        }
+    }
+    
     outputModelStream.close();
+    if (outputModelStream.fail()) {
+        std::cerr << "error: can't write file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+}
+
+// Writes values as the initializer of a constexpr array, valuesPerLine per line (one zero if there is none,
+// since an array can't be empty)
+template <typename T>
+static void writeArrayInitializer(std::ostream& outputStream, const std::string& declaration,
+                                  const std::vector<T>& values, const int valuesPerLine)
+{
+    outputStream << declaration << "[] = {";
+    if (values.empty()) outputStream << " 0";
+    for (size_t valueIndex = 0; valueIndex < values.size(); ++valueIndex) {
+        if (valueIndex%valuesPerLine == 0) outputStream << std::endl << "   ";
+        outputStream << " " << values[valueIndex] << (valueIndex + 1 < values.size() ? "," : "");
+    }
+    outputStream << std::endl << "};" << std::endl;
+}
+
+void AdaBoost::writePredictorHeader(const std::string filename, const std::string& name, const bool groupByFeature) const {
+    if (!compiled_) {
+        std::cerr << "error: the model has to be compiled before it is exported" << std::endl;
+        exit(1);
+    }
+    
+    std::ofstream outputStream(filename.c_str(), std::ios_base::out);
+    if (outputStream.fail()) {
+        std::cerr << "error: can't open file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    std::string guardName;
+    for (size_t charIndex = 0; charIndex < name.size(); ++charIndex) {
+        guardName += isalnum(static_cast<unsigned char>(name[charIndex])) ? static_cast<char>(toupper(name[charIndex])) : '_';
+    }
+    guardName += "_H";
+    
+    int roundTotal = static_cast<int>(weakClassifiers_.size());
+    outputStream << "// Predictor generated by abexport from an AdaBoost model of " << roundTotal << " rounds" << std::endl;
+    outputStream << "// Stumps are constexpr tables, and the score is summed by templates which the compiler unrolls" << std::endl;
+    outputStream << "// (halves are summed separately, so that the recursion depth is logarithmic). A stump selects" << std::endl;
+    outputStream << "// its output by the result of its comparison, without a branch." << std::endl;
+    outputStream << std::endl;
+    outputStream << "#ifndef " << guardName << std::endl;
+    outputStream << "#define " << guardName << std::endl;
+    outputStream << std::endl;
+    outputStream << "namespace " << name << " {" << std::endl;
+    outputStream << std::endl;
+    outputStream << "// Number of features read by predict (features[0, featureDimension))" << std::endl;
+    outputStream << "constexpr int featureDimension = " << featureDimension() << ";" << std::endl;
+    outputStream << std::endl;
+    outputStream << std::setprecision(17);
+    
+    if (groupByFeature) {
+        int groupTotal = static_cast<int>(compiledFeatureIndices_.size());
+        outputStream << "// Used feature k has thresholds groupThresholds[groupThresholdOffsets[k], groupThresholdOffsets[k+1])" << std::endl;
+        outputStream << "// in ascending order, and its score for values larger than exactly p of them is" << std::endl;
+        outputStream << "// groupScores[groupThresholdOffsets[k] + k + p] (the sum of the outputs of its stumps)." << std::endl;
+        outputStream << "constexpr int groupTotal = " << groupTotal << ";" << std::endl;
+        writeArrayInitializer(outputStream, "constexpr int groupFeatureIndices", compiledFeatureIndices_, 16);
+        writeArrayInitializer(outputStream, "constexpr int groupThresholdOffsets", compiledThresholdOffsets_, 16);
+        writeArrayInitializer(outputStream, "constexpr double groupThresholds", compiledThresholds_, 4);
+        writeArrayInitializer(outputStream, "constexpr double groupScores", compiledScores_, 4);
+        outputStream << R"(
+namespace detail {
+
+// Number of the thresholds [Begin, Begin + Length) smaller than the value
+template <int Begin, int Length>
+struct SmallerThresholdCount {
+    static inline int evaluate(const double value) {
+        return SmallerThresholdCount<Begin, Length/2>::evaluate(value)
+               + SmallerThresholdCount<Begin + Length/2, Length - Length/2>::evaluate(value);
+    }
+};
+template <int Begin>
+struct SmallerThresholdCount<Begin, 1> {
+    static inline int evaluate(const double value) { return value > groupThresholds[Begin] ? 1 : 0; }
+};
+template <int Begin>
+struct SmallerThresholdCount<Begin, 0> {
+    static inline int evaluate(const double) { return 0; }
+};
+
+// Sum of the scores of the used features [Begin, Begin + Length)
+template <int Begin, int Length>
+struct ScoreSum {
+    static inline double evaluate(const double* features) {
+        return ScoreSum<Begin, Length/2>::evaluate(features) + ScoreSum<Begin + Length/2, Length - Length/2>::evaluate(features);
+    }
+};
+template <int Begin>
+struct ScoreSum<Begin, 1> {
+    static inline double evaluate(const double* features) {
+        return groupScores[groupThresholdOffsets[Begin] + Begin
+                           + SmallerThresholdCount<groupThresholdOffsets[Begin],
+                                                   groupThresholdOffsets[Begin + 1] - groupThresholdOffsets[Begin]>
+                             ::evaluate(features[groupFeatureIndices[Begin]])];
+    }
+};
+template <int Begin>
+struct ScoreSum<Begin, 0> {
+    static inline double evaluate(const double*) { return 0.0; }
+};
+
+}
+
+// Score of a sample: features[d] is the value of feature d (0-based)
+inline double predict(const double* features) {
+    return detail::ScoreSum<0, groupTotal>::evaluate(features);
+}
+)";
+    } else {
+        std::vector<int> featureIndices(roundTotal);
+        std::vector<double> thresholds(roundTotal);
+        std::vector<double> outputs(2*roundTotal);
+        for (int roundIndex = 0; roundIndex < roundTotal; ++roundIndex) {
+            featureIndices[roundIndex] = weakClassifiers_[roundIndex].featureIndex();
+            thresholds[roundIndex] = weakClassifiers_[roundIndex].threshold();
+            outputs[2*roundIndex] = weakClassifiers_[roundIndex].outputSmaller();
+            outputs[2*roundIndex + 1] = weakClassifiers_[roundIndex].outputLarger();
+        }
+        outputStream << "// Stump r outputs stumpOutputs[2r + 1] if features[stumpFeatureIndices[r]] > stumpThresholds[r]," << std::endl;
+        outputStream << "// otherwise stumpOutputs[2r]" << std::endl;
+        outputStream << "constexpr int roundTotal = " << roundTotal << ";" << std::endl;
+        writeArrayInitializer(outputStream, "constexpr int stumpFeatureIndices", featureIndices, 16);
+        writeArrayInitializer(outputStream, "constexpr double stumpThresholds", thresholds, 4);
+        writeArrayInitializer(outputStream, "constexpr double stumpOutputs", outputs, 4);
+        outputStream << R"(
+namespace detail {
+
+// Sum of the outputs of the stumps [Begin, Begin + Length)
+template <int Begin, int Length>
+struct ScoreSum {
+    static inline double evaluate(const double* features) {
+        return ScoreSum<Begin, Length/2>::evaluate(features) + ScoreSum<Begin + Length/2, Length - Length/2>::evaluate(features);
+    }
+};
+template <int Begin>
+struct ScoreSum<Begin, 1> {
+    static inline double evaluate(const double* features) {
+        return stumpOutputs[2*Begin + (features[stumpFeatureIndices[Begin]] > stumpThresholds[Begin] ? 1 : 0)];
+    }
+};
+template <int Begin>
+struct ScoreSum<Begin, 0> {
+    static inline double evaluate(const double*) { return 0.0; }
+};
+
+}
+
+// Score of a sample: features[d] is the value of feature d (0-based)
+inline double predict(const double* features) {
+    return detail::ScoreSum<0, roundTotal>::evaluate(features);
+}
+)";
+    }
+    
+    outputStream << R"(
+// Scores sampleTotal samples stored row by row: feature d of sample i is samples[i*stride + d]
+inline void predictBatch(const double* samples, const int sampleTotal, const long long stride, double* scores) {
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) scores[sampleIndex] = predict(samples + sampleIndex*stride);
+}
+
+}
+
+#endif
+)";
+    
+    outputStream.close();
+    if (outputStream.fail()) {
+        std::cerr << "error: can't write file (" << filename << ")" << std::endl;
+        exit(1);
+    }
 }
 
 void AdaBoost::readFile(const std::string filename) {
-    std::ifstream inputModelStream(filename.c_str(), std::ios_base::in);
-    if (inputModelStream.fail()) {
+    ModelFileStatus status = loadFile(filename);
+    if (status == ModelFileCantOpen) {
         std::cerr << "error: can't open file (" << filename << ")" << std::endl;
         exit(1);
     }
+    if (status == ModelFileBadFormat) {
+        std::cerr << "error: bad format in model file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+}
+
+AdaBoost::ModelFileStatus AdaBoost::loadFile(const std::string filename) {
+    std::ifstream inputModelStream(filename.c_str(), std::ios_base::in);
+    if (inputModelStream.fail()) return ModelFileCantOpen;
     
+    // Stumps are appended as they are read, so that a wrong count fails at the end of the file
     int roundTotal;
-    inputModelStream >> roundTotal;
-    weakClassifiers_.resize(roundTotal);
+    if (!(inputModelStream >> roundTotal) || roundTotal < 0) return ModelFileBadFormat;
+    std::vector<DecisionStump> weakClassifiers;
     for (int roundIndex = 0; roundIndex < roundTotal; ++roundIndex) {
         int featureIndex;
         double threshold, outputLarger, outputSmaller;
@@ -371,9 +2949,27 @@ void AdaBoost::readFile(const std::string filename) {
         inputModelStream >> threshold;
         inputModelStream >> outputLarger;
         inputModelStream >> outputSmaller;
+        if (inputModelStream.fail() || featureIndex < 0) return ModelFileBadFormat;
         
-        weakClassifiers_[roundIndex].set(featureIndex, threshold, outputLarger, outputSmaller);
+        weakClassifiers.push_back(DecisionStump());
+        weakClassifiers.back().set(featureIndex, threshold, outputLarger, outputSmaller);
+    }
+    
+    std::vector<double> cascadeThresholds;
+    std::string sectionName;
+    if (inputModelStream >> sectionName && sectionName == "cascade") {
+        for (int roundIndex = 0; roundIndex < roundTotal; ++roundIndex) {
+            double cascadeThreshold;
+            if (!(inputModelStream >> cascadeThreshold)) return ModelFileBadFormat;
+            cascadeThresholds.push_back(cascadeThreshold);
+        }
     }
     
     inputModelStream.close();
+    
+    weakClassifiers_.swap(weakClassifiers);
+    cascadeThresholds_.swap(cascadeThresholds);
+    compile();
+    
+    return ModelFileRead;
 }
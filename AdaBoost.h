@@ -30,21 +30,167 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <vector>
+#include <memory>
+#include "MappedFile.h"
+#include "StorageArray.h"
+
+class ThreadPool;
+class SocketChannel;
+struct SparseSampleData;
 
 class AdaBoost {
 public:
-    AdaBoost(const int boostingType = 2)
-        : boostingType_(boostingType), featureTotal_(0), sampleTotal_(0) {}
+    AdaBoost(const int boostingType = 2);
+    ~AdaBoost();
     
     void setBoostingType(const int boostingType);
+    void setThreadTotal(const int threadTotal);
+    // Quantizes each feature into at most binTotal (<= 256) bins instead of trying every distinct value
+    // as a threshold (0: exact). It has to be set before setTrainingSamples.
+    void setBinTotal(const int binTotal);
+    // Out-of-core training of a binary training sample file: the sorted columns stay in the mapped file and are
+    // streamed in blocks of consecutive columns every round, with read-ahead of the next block, so that the
+    // resident memory stays under megabytes (0: no budget). It has to be set before setTrainingSamples and
+    // can't be used with binning, compact storage or weight trimming.
+    void setMemoryBudget(const long long megabytes);
+    // Keeps only nonzero feature values, so that training time and memory scale with the number of nonzero values.
+    // It has to be set before setTrainingSamples and can't be used with binning.
+    void setSparseTraining(const bool sparseTraining);
+    // Stores sorted feature values as float and, with at most 65536 samples, sample indices as 16-bit integers,
+    // which reduces the memory of the sorted columns from 12 to 6 bytes per value. Thresholds are then
+    // midpoints of single-precision values. It has to be set before setTrainingSamples and can't be used with binning.
+    void setCompactStorage(const bool compactStorage);
+    // Weight trimming: every refreshInterval rounds, the samples holding weightRate of the total weight
+    // (largest weights first) are selected, and the following rounds learn stumps from them only.
+    // The weights of all samples are still updated. Trimming is skipped until the next refresh
+    // if it would keep more than half of the samples (0: no trimming).
+    void setWeightTrimming(const double weightRate, const int refreshInterval = 10);
+    // Evaluates only a random featureRate fraction of the features every round, together with the keptFeatureTotal
+    // features whose stumps had the smallest errors in the previous round (featureRate 0: all features).
+    void setFeatureSampling(const double featureRate, const int keptFeatureTotal = 0);
+    // Gradient-based one-side sampling: every round learns the stump from the topRate fraction of the samples
+    // with the largest weights and a random otherRate fraction of the others, whose weights are multiplied
+    // by (1 - topRate)/otherRate. The weights of all samples are still updated. It needs binning (topRate 0: off).
+    void setGradientSampling(const double topRate, const double otherRate);
+    // Skips features whose lower bound of the error can't beat the best stump found so far in the round.
+    // The bound of a scanned feature is the smallest error any split could have with the best outputs,
+    // and it is lowered by the largest possible effect of every later weight update. The model is the same
+    // as without pruning. It can't be used with kept features of feature sampling. Experimental: the bounds
+    // are seldom tight enough to skip many features, so it doesn't usually make training faster.
+    void setPruning(const bool pruning);
+    // Seed of feature and sample sampling; random draws depend only on the seed and the round index
+    void setRandomSeed(const unsigned int seed);
+    // Reads a text (SVM-light) file or a binary training sample file, which is memory-mapped
+    // and used without sorting. A binary file keeps the sparse or dense layout it was written with.
     void setTrainingSamples(const std::string& trainingDataFilename);
+    // Writes the sorted training samples as a binary training sample file
+    void writeTrainingSampleFile(const std::string filename) const;
+    
+    // Continues training from a model (warm start): its stumps are replayed over the training samples
+    // to rebuild the sample weights, as if they had been trained on them. It has to be called after
+    // setTrainingSamples. Cascade thresholds of the model are discarded, and kept features of feature
+    // sampling start empty.
+    void setInitialModel(const std::string& modelFilename);
+    // Writes the model to filename every interval rounds of train (0: no checkpoint).
+    // A checkpoint is a model file, which can be given to setInitialModel to resume training.
+    void setCheckpoint(const std::string& filename, const int interval);
+    
+    // Reads validation samples (text file); their scores are updated with the stump of every round.
+    // It has to be called after setTrainingSamples and setInitialModel.
+    void setValidationSamples(const std::string& validationDataFilename);
+    // Stops train when the exponential loss of the validation samples hasn't decreased for roundTotal rounds
+    // and keeps the rounds up to the smallest loss (0: no early stopping). The weights are then those
+    // of the last trained round, so training is continued by setInitialModel.
+    void setEarlyStopping(const int roundTotal);
+    // Writes the exponential loss and accuracy of the training and validation samples to filename
+    // every round of train (empty: none)
+    void setProgressFile(const std::string& filename);
     
+    // Trains rounds until the model has roundTotal stumps (an initial model with more stumps is an error)
     void train(const int roundTotal, const bool verbose = false);
+    // Trains rounds until the model has roundTotal stumps over training samples split into text files, without
+    // holding them in one process. A worker process is forked for each shard, reads it and keeps its samples and
+    // weights, and exchanges messages with this process over a Unix socket pair. Bin thresholds are computed from
+    // merged quantile summaries of the shards. Every round, the workers send weight histograms, which are added
+    // here to choose the stump, and update their weights with it. The stumps of the initial model (empty: none)
+    // are replayed into the weights first, so that a checkpoint is continued. It needs binning and can't be used
+    // with sampling, pruning, sparse or compact storage and validation samples; the training samples set before
+    // are discarded.
+    void trainSharded(const std::vector<std::string>& shardFilenames, const int roundTotal,
+                      const std::string& initialModelFilename, const bool verbose = false);
+    // Sets a rejection threshold for every round from the partial sums of the training samples (soft cascade).
+    // The protected samples are the detectionRate fraction of the detected positives with the highest scores,
+    // and the threshold of a round is the smallest partial sum among them. It has to be called after train.
+    void calibrateCascade(const double detectionRate, const bool verbose = false);
     
     double predict(const std::vector<double>& featureVector) const;
+    // Score of a sample whose feature d is features[d] for d < featureTotal and 0 from featureTotal on.
+    // The stumps are added in round order, so the score of a double sample is exactly that of predictBatch.
+    double predict(const double* features, const int featureTotal) const;
+    double predict(const float* features, const int featureTotal) const;
+    // Score of a sparse sample: feature featureIndices[k] has the value featureValues[k] (the indices are
+    // distinct) and the others are 0. Only the features used by the model are looked up: the score of
+    // the zero sample is precomputed, and a used feature adds the change of its score. Indices which
+    // aren't used by the model are ignored. It has to be called on a compiled model.
+    double predictSparse(const int* featureIndices, const double* featureValues, const int elementTotal) const;
+    
+    enum SampleLayout { RowMajor, ColumnMajor };
+    // AllFeatures: the samples hold features [0, featureDimension()). UsedFeatures: they hold only
+    // the features used by the model, feature usedFeatureIndex(k) in column k (the model has to be compiled),
+    // so that the block of a wide sparse model stays small.
+    enum SampleColumns { AllFeatures, UsedFeatures };
+    // Scores sampleTotal samples stored in one block and writes them to scores[0, sampleTotal)
+    // Row-major: column d of sample i is samples[i*stride + d], column-major: samples[d*stride + i].
+    // Stumps are evaluated over many samples at once with SIMD kernels. Scores are added in round order,
+    // so they are exactly those of an uncompiled predict.
+    void predictBatch(const double* samples,
+                      const int sampleTotal,
+                      const long long stride,
+                      const SampleLayout layout,
+                      double* scores,
+                      const SampleColumns columns = AllFeatures) const;
+    
+    // Same as predictBatch, except that a sample stops being scored as soon as its partial sum falls below
+    // the cascade threshold of the round; its score is then clamped to at most 0. Scores of the samples
+    // which are not rejected are exactly those of predictBatch. Returns the total number of stumps evaluated.
+    long long predictCascade(const double* samples,
+                             const int sampleTotal,
+                             const long long stride,
+                             const SampleLayout layout,
+                             double* scores,
+                             const SampleColumns columns = AllFeatures) const;
+    
+    // The number of features needed by the model (largest used feature index + 1)
+    int featureDimension() const;
+    // Features used by the compiled model in ascending order, and the column of a feature among them
+    // (-1: not used)
+    int usedFeatureTotal() const { return static_cast<int>(compiledFeatureIndices_.size()); }
+    int usedFeatureIndex(const int usedIndex) const { return compiledFeatureIndices_[usedIndex]; }
+    int usedFeatureColumn(const int featureIndex) const {
+        if (featureIndex < 0 || featureIndex >= static_cast<int>(compiledUsedIndices_.size())) return -1;
+        return compiledUsedIndices_[featureIndex];
+    }
     
     void writeFile(const std::string filename) const;
+    // Writes a self-contained C++ header with the model as constexpr tables in namespace name, whose
+    // predict(features) sums the stumps with template recursion the compiler unrolls and inlines.
+    // With groupByFeature, the tables are those of the compiled model (one threshold count per used feature).
+    // Scores are the same terms added in a different order. It has to be called on a compiled model.
+    void writePredictorHeader(const std::string filename, const std::string& name, const bool groupByFeature) const;
+    // Reads a model and compiles it
     void readFile(const std::string filename);
+    enum ModelFileStatus { ModelFileRead, ModelFileCantOpen, ModelFileBadFormat };
+    // Same as readFile, except that errors are returned instead of exiting.
+    // The model is left unchanged if the file can't be read.
+    ModelFileStatus loadFile(const std::string filename);
+    
+    // Groups the stumps by feature: for each used feature, its thresholds are sorted and the sum of
+    // its stumps' outputs is precomputed for every interval between them. predict then needs one
+    // binary search per used feature instead of one comparison per round. Scores are the same sums
+    // added in a different order, so they differ from the round-by-round sum only by rounding
+    // (relative to the sum of absolute outputs, less than about 1e-16 times the number of rounds).
+    // Training a round discards the compiled model.
+    void compile();
     
 private:
     class DecisionStump {
@@ -74,11 +220,82 @@ private:
         double error_;
     };
     
+    // Work of the stump search, counted for profiling
+    struct ScanCounts {
+        long long featureTotal;
+        long long thresholdTotal;
+        long long sampleTotal;
+    };
+    
+    void readTrainingSampleFile(const std::string& filename);
+    static int countSmallerThresholds(const double* thresholds, const int thresholdTotal, const double featureValue);
+    template <typename T> double predictFeatures(const T* features, const int featureTotal) const;
     void initializeWeights();
-    void sortSampleIndices();
+    void addValidationScores(const DecisionStump& classifier);
+    void recomputeScores();
+    void computeScoreStatistics(const std::vector<double>& scores,
+                                const std::vector<signed char>& labels,
+                                double& loss,
+                                double& accuracy) const;
+    void writeCheckpoint() const;
+    // Out-of-core training: size of the blocks of columns from the memory budget, and access hints for columns
+    void setColumnBlockBytes();
+    void adviseColumns(const int featureBegin, const int featureEnd, const MappedFile::Advice advice) const;
+    void adviseCandidateColumns(const std::vector<int>& candidateFeatures,
+                                const std::vector<int>& candidateIndices,
+                                const int begin,
+                                const int end,
+                                const MappedFile::Advice advice) const;
+    void runShardWorker(SocketChannel& channel, const std::string& shardFilename);
+    // Releases the samples after transposing them, to lower the peak memory
+    void sortSampleIndices(SparseSampleData& samples);
+    void computeTieRuns();
+    void quantizeFeatures(const SparseSampleData& samples);
+    void quantizeSortedColumns();
+    void quantizeSortedColumn(const int featureIndex, const double* sortedValues, const int* sortedIndices);
     void trainRound();
+    void selectActiveSamples();
+    void selectGradientSamples();
+    void selectCandidateFeatures(std::vector<int>& candidateFeatures) const;
+    void updateKeptFeatures(const std::vector<int>& candidateFeatures, const std::vector<double>& candidateErrors);
+    void updateErrorBounds(const DecisionStump& bestClassifier, const std::vector<double>& blockGroupWeightSums,
+                           const double updatedWeightSum);
+    void selectLeadingCandidates(const std::vector<int>& candidateFeatures, std::vector<int>& leadingCandidateIndices) const;
+    size_t gatherActiveColumn(const int featureIndex, double* activeValues, int* activeIndices) const;
     void calcWeightSum();
-    DecisionStump learnOptimalClassifier(const int featureIndex);
+    // errorBound (if not NULL) is set to the lower bound of the error over all splits of the feature
+    DecisionStump learnOptimalClassifier(const int featureIndex,
+                                         std::vector<double>& sortedLabelWeights,
+                                         double* errorBound,
+                                         ScanCounts& scanCounts);
+    template <typename ValueType, typename IndexType>
+    DecisionStump learnOptimalSortedClassifier(const int featureIndex,
+                                               const ValueType* sortedValues,
+                                               const IndexType* sortedIndices,
+                                               const int* runEnds,
+                                               const int columnLength,
+                                               const int columnSampleTotal,
+                                               std::vector<double>& sortedLabelWeights,
+                                               double* errorBound,
+                                               ScanCounts& scanCounts);
+    DecisionStump learnOptimalBinnedClassifier(const int featureIndex,
+                                               std::vector<double>& binWeightSums,
+                                               double* errorBound,
+                                               ScanCounts& scanCounts);
+    // Histograms of the positive and negative weights of the active samples over the bins of the feature
+    void accumulateBinWeightSums(const int featureIndex, double* positiveBinWeightSums, double* negativeBinWeightSums) const;
+    DecisionStump scanBinWeightSums(const int featureIndex,
+                                    const double* positiveBinWeightSums,
+                                    const double* negativeBinWeightSums,
+                                    double* errorBound,
+                                    ScanCounts& scanCounts) const;
+    void updateOptimalClassifier(const int featureIndex,
+                                 const double threshold,
+                                 const double weightSumLarger,
+                                 const double weightLabelSumLarger,
+                                 const double positiveWeightSumLarger,
+                                 const double negativeWeightSumLarger,
+                                 DecisionStump& optimalClassifier) const;
     void computeClassifierOutputs(const double weightSumLarger,
                                   const double weightLabelSumLarger,
                                   const double positiveWeightSumLarger,
@@ -89,20 +306,115 @@ private:
                         const double negativeWeightSumLarger,
                         const double outputLarger,
                         const double outputSmaller) const;
-    void updateWeight(const DecisionStump& bestClassifier);
+    double computeErrorBound(const double positiveWeightSumLarger, const double negativeWeightSumLarger) const;
+    bool isBetterClassifier(const DecisionStump& candidateClassifier, const DecisionStump& currentClassifier) const;
+    void evaluateTrainingSamples(const DecisionStump& classifier, std::vector<double>& outputs) const;
+    template <typename ValueType, typename IndexType>
+    void evaluateSortedColumn(const DecisionStump& classifier,
+                              const ValueType* sortedValues,
+                              const IndexType* sortedIndices,
+                              std::vector<double>& outputs) const;
+    bool hasCompactSampleIndices() const;
+    // Returns the sum of the updated weights before they are normalized
+    double updateWeight(const DecisionStump& bestClassifier);
 
     int boostingType_;
+    std::unique_ptr<ThreadPool> threadPool_;
+    
+    // Compiled model
+    // Used feature k has thresholds compiledThresholds_[compiledThresholdOffsets_[k], compiledThresholdOffsets_[k+1])
+    // in ascending order and scores compiledScores_[compiledThresholdOffsets_[k] + k + p] for values
+    // larger than exactly p of them.
+    bool compiled_;
+    std::vector<int> compiledFeatureIndices_;
+    std::vector<int> compiledThresholdOffsets_;
+    std::vector<double> compiledThresholds_;
+    std::vector<double> compiledScores_;
+    // Used index of each feature (-1: not used), score of each used feature for the value 0 and their sum
+    std::vector<int> compiledUsedIndices_;
+    std::vector<double> compiledZeroScores_;
+    double compiledZeroScore_;
+    // Stumps as separate arrays for batch prediction
+    std::vector<int> stumpFeatureIndices_;
+    std::vector<double> stumpThresholds_;
+    std::vector<double> stumpOutputsLarger_;
+    std::vector<double> stumpOutputsSmaller_;
+    // Column of the feature of each stump among the used features
+    std::vector<int> stumpUsedIndices_;
+    int binTotal_;
+    bool sparseTraining_;
+    bool compactStorage_;
     int featureTotal_;
     std::vector<DecisionStump> weakClassifiers_;
+    std::string checkpointFilename_;
+    int checkpointInterval_;
+    // Rejection threshold of each round (soft cascade), empty if not calibrated
+    std::vector<double> cascadeThresholds_;
     
     // Training samples
     int sampleTotal_;
-    std::vector< std::vector<double> > samples_;
-    std::vector<bool> labels_;
+    std::vector<signed char> labels_;
     std::vector<double> weights_;
+    // Sum of the outputs of all stumps for each sample, updated every round
+    std::vector<double> trainingScores_;
+    
+    // Validation samples, stored as columns of nonzero values in sample order
+    // Column d is [validationColumnOffsets_[d], validationColumnOffsets_[d+1]).
+    int validationSampleTotal_;
+    std::vector<signed char> validationLabels_;
+    std::vector<size_t> validationColumnOffsets_;
+    std::vector<int> validationSampleIndices_;
+    std::vector<double> validationFeatureValues_;
+    std::vector<double> validationScores_;
+    int earlyStoppingRoundTotal_;
+    std::string progressFilename_;
 
     // Data for training
-    std::vector< std::vector<int> > sortedSampleIndices_;
+    // Feature values are stored column by column, each column sorted by value
+    // Column d is [columnOffsets_[d], columnOffsets_[d+1]) and holds all samples or, in sparse training, nonzero values
+    StorageArray<size_t> columnOffsets_;
+    StorageArray<double> sortedFeatureValues_;
+    StorageArray<int> sortedSampleIndices_;
+    // Compact storage of the same columns (float values, and 16-bit indices if the samples fit)
+    StorageArray<float> compactFeatureValues_;
+    StorageArray<unsigned short> compactSampleIndices_;
+    // Runs of equal values in the sorted columns, found once after sorting: run r of column d ends at position
+    // sortedRunEnds_[r] of the column, r in [runOffsets_[d], runOffsets_[d+1]) (no run if the column has few ties,
+    // empty out of core)
+    std::vector<size_t> runOffsets_;
+    std::vector<int> sortedRunEnds_;
+    std::unique_ptr<MappedFile> sampleFile_;
+    // Memory budget in bytes and size of the blocks of mapped columns scanned together (0: in memory)
+    long long memoryBudget_;
+    long long columnBlockBytes_;
+    // Bin codes in sample order ([feature][sample]) and thresholds between neighboring bins (binning mode)
+    std::vector<unsigned char> sampleBins_;
+    std::vector< std::vector<double> > binThresholds_;
+    // Weight multiplied by label (+1/-1) of each sample
+    std::vector<double> labelWeights_;
+    std::vector< std::vector<double> > threadScanBuffers_;
+    std::vector<double> classifierOutputs_;
+    // Weight trimming and gradient-based sampling: active samples and the active entries of the sorted columns
+    // (empty if all samples are active). A flag is 0 for inactive samples, 1 for active samples and
+    // scaledSampleFlag for samples whose weights are multiplied by sampledWeightScale_.
+    double trimmingWeightRate_;
+    int trimmingRefreshInterval_;
+    double gradientTopRate_;
+    double gradientOtherRate_;
+    double sampledWeightScale_;
+    std::vector<char> activeSampleFlags_;
+    std::vector<int> activeSampleIndices_;
+    std::vector<size_t> activeColumnOffsets_;
+    std::vector<double> activeFeatureValues_;
+    std::vector<int> activeColumnSampleIndices_;
+    // Feature sampling
+    double featureSamplingRate_;
+    int keptFeatureTotal_;
+    unsigned int randomSeed_;
+    std::vector<int> keptFeatureIndices_;
+    // Lower bounds of the errors of the features for the current weights (pruning)
+    bool pruning_;
+    std::vector<double> featureErrorBounds_;
     double weightSum_;
     double weightLabelSum_;
     double positiveWeightSum_;
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+    
+    int fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) return false;
+    
+    struct stat fileStatus;
+    if (fstat(fileDescriptor, &fileStatus) != 0) {
+        ::close(fileDescriptor);
+        return false;
+    }
+    size_ = static_cast<long long>(fileStatus.st_size);
+    
+    if (size_ > 0) {
+        void* mappedData = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mappedData == MAP_FAILED) {
+            ::close(fileDescriptor);
+            size_ = 0;
+            return false;
+        }
+        data_ = reinterpret_cast<const char*>(mappedData);
+    }
+    ::close(fileDescriptor);
+    
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != NULL) munmap(const_cast<char*>(data_), size_);
+    data_ = NULL;
+    size_ = 0;
+}
+
+void MappedFile::advise(const long long offset, const long long length, const Advice advice) const {
+    if (data_ == NULL || length <= 0) return;
+    
+    int systemAdvice = MADV_NORMAL;
+    switch (advice) {
+        case Sequential: systemAdvice = MADV_SEQUENTIAL; break;
+        case WillNeed: systemAdvice = MADV_WILLNEED; break;
+        case DontNeed: systemAdvice = MADV_DONTNEED; break;
+    }
+    
+    // madvise needs a page-aligned address
+    long long pageSize = sysconf(_SC_PAGESIZE);
+    long long alignedOffset = offset/pageSize*pageSize;
+    madvise(const_cast<char*>(data_) + alignedOffset, offset + length - alignedOffset, systemAdvice);
+}
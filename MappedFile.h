@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() : data_(NULL), size_(0) {}
+    ~MappedFile() { close(); }
+    
+    // Returns false if the file can't be opened or mapped
+    bool open(const std::string& filename);
+    void close();
+    
+    const char* data() const { return data_; }
+    long long size() const { return size_; }
+    
+    // Access pattern hints for the range [offset, offset + length)
+    // DontNeed drops the resident pages of the range (they are read from the file again if accessed).
+    enum Advice { Sequential, WillNeed, DontNeed };
+    void advise(const long long offset, const long long length, const Advice advice) const;
+    void adviseSequential(const long long offset, const long long length) const { advise(offset, length, Sequential); }
+    void adviseWillNeed(const long long offset, const long long length) const { advise(offset, length, WillNeed); }
+    void adviseDontNeed(const long long offset, const long long length) const { advise(offset, length, DontNeed); }
+    
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    
+    const char* data_;
+    long long size_;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Profiler.h"
+#include <cstdio>
+#include <mutex>
+#include <chrono>
+#include <sys/resource.h>
+
+static FILE* profileFile = NULL;
+static std::mutex profileMutex;
+
+ProfileRecord::ProfileRecord(const char* type) {
+    text_ = std::string("{\"type\": \"") + type + "\"";
+}
+
+ProfileRecord& ProfileRecord::addNumber(const char* key, const double value) {
+    char valueString[32];
+    snprintf(valueString, sizeof(valueString), "%.9g", value);
+    text_ = text_ + ", \"" + key + "\": " + valueString;
+    return *this;
+}
+
+ProfileRecord& ProfileRecord::addInteger(const char* key, const long long value) {
+    char valueString[32];
+    snprintf(valueString, sizeof(valueString), "%lld", value);
+    text_ = text_ + ", \"" + key + "\": " + valueString;
+    return *this;
+}
+
+ProfileRecord& ProfileRecord::addString(const char* key, const char* value) {
+    text_ = text_ + ", \"" + key + "\": \"" + value + "\"";
+    return *this;
+}
+
+bool Profiler::open(const std::string& filename) {
+    close();
+    
+    std::lock_guard<std::mutex> lock(profileMutex);
+    profileFile = fopen(filename.c_str(), "w");
+    return profileFile != NULL;
+}
+
+void Profiler::close() {
+    std::lock_guard<std::mutex> lock(profileMutex);
+    if (profileFile != NULL) fclose(profileFile);
+    profileFile = NULL;
+}
+
+bool Profiler::enabled() {
+    return profileFile != NULL;
+}
+
+void Profiler::write(const ProfileRecord& record) {
+    std::string text = record.text();
+    std::lock_guard<std::mutex> lock(profileMutex);
+    if (profileFile == NULL) return;
+    fprintf(profileFile, "%s\n", text.c_str());
+    fflush(profileFile);
+}
+
+double Profiler::now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long long Profiler::peakResidentKilobytes() {
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<long long>(usage.ru_maxrss);
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(const char* phaseName)
+    : phaseName_(phaseName), beginTime_(Profiler::enabled() ? Profiler::now() : 0.0) {}
+
+ScopedPhaseTimer::~ScopedPhaseTimer() {
+    if (!Profiler::enabled()) return;
+    
+    ProfileRecord record("phase");
+    record.addString("name", phaseName_);
+    record.addNumber("seconds", Profiler::now() - beginTime_);
+    record.addInteger("peak_rss_kb", Profiler::peakResidentKilobytes());
+    Profiler::write(record);
+}
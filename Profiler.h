@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+
+// Fields of one telemetry record, written as a JSON object on one line
+class ProfileRecord {
+public:
+    explicit ProfileRecord(const char* type);
+    
+    // Keys and string values are written as they are, so they must not need escaping
+    ProfileRecord& addNumber(const char* key, const double value);
+    ProfileRecord& addInteger(const char* key, const long long value);
+    ProfileRecord& addString(const char* key, const char* value);
+    
+    std::string text() const { return text_ + "}"; }
+    
+private:
+    std::string text_;
+};
+
+// Process-wide writer of performance telemetry (JSON lines)
+// Nothing is measured until open is called, so instrumented code only pays a branch when profiling is off.
+class Profiler {
+public:
+    // Returns false if the file can't be opened
+    static bool open(const std::string& filename);
+    static void close();
+    static bool enabled();
+    
+    // Writes the record; safe to call from several threads
+    static void write(const ProfileRecord& record);
+    
+    // Seconds of a monotonic clock
+    static double now();
+    // Peak resident set size of the process in kilobytes
+    static long long peakResidentKilobytes();
+};
+
+// Writes a "phase" record with the elapsed time and the peak resident set size when it goes out of scope
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(const char* phaseName);
+    ~ScopedPhaseTimer();
+    
+private:
+    ScopedPhaseTimer(const ScopedPhaseTimer&);
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&);
+    
+    const char* phaseName_;
+    double beginTime_;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SocketChannel.h"
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+
+void SocketChannel::reset(const int socketDescriptor) {
+    close();
+    socketDescriptor_ = socketDescriptor;
+}
+
+void SocketChannel::close() {
+    if (socketDescriptor_ >= 0) ::close(socketDescriptor_);
+    socketDescriptor_ = -1;
+}
+
+void SocketChannel::send(const void* data, const size_t size) {
+    const char* sendData = reinterpret_cast<const char*>(data);
+    size_t sentSize = 0;
+    while (sentSize < size) {
+        // MSG_NOSIGNAL: a closed peer is reported as an error instead of SIGPIPE
+        ssize_t writtenSize = ::send(socketDescriptor_, sendData + sentSize, size - sentSize, MSG_NOSIGNAL);
+        if (writtenSize < 0 && errno == EINTR) continue;
+        if (writtenSize <= 0) {
+            std::cerr << "error: lost connection between training processes" << std::endl;
+            exit(1);
+        }
+        sentSize += static_cast<size_t>(writtenSize);
+    }
+}
+
+void SocketChannel::receive(void* data, const size_t size) {
+    char* receiveData = reinterpret_cast<char*>(data);
+    size_t receivedSize = 0;
+    while (receivedSize < size) {
+        ssize_t readSize = ::recv(socketDescriptor_, receiveData + receivedSize, size - receivedSize, 0);
+        if (readSize < 0 && errno == EINTR) continue;
+        if (readSize <= 0) {
+            std::cerr << "error: lost connection between training processes" << std::endl;
+            exit(1);
+        }
+        receivedSize += static_cast<size_t>(readSize);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SOCKETCHANNEL_H
+#define SOCKETCHANNEL_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+// Blocking byte stream over a connected socket (e.g. one end of a Unix socket pair)
+// Values are sent in the native representation, so both ends have to run on the same machine.
+// A failed transfer is an error which exits the process, since the other end can't be recovered.
+class SocketChannel {
+public:
+    explicit SocketChannel(const int socketDescriptor = -1) : socketDescriptor_(socketDescriptor) {}
+    ~SocketChannel() { close(); }
+    
+    void reset(const int socketDescriptor);
+    void close();
+    
+    void send(const void* data, const size_t size);
+    void receive(void* data, const size_t size);
+    
+    template <typename T>
+    void sendValue(const T& value) { send(&value, sizeof(T)); }
+    template <typename T>
+    T receiveValue() {
+        T value;
+        receive(&value, sizeof(T));
+        return value;
+    }
+    
+    // Arrays are sent as their length followed by the elements
+    template <typename T>
+    void sendArray(const std::vector<T>& values) {
+        sendValue<int64_t>(static_cast<int64_t>(values.size()));
+        if (!values.empty()) send(&values[0], values.size()*sizeof(T));
+    }
+    template <typename T>
+    void receiveArray(std::vector<T>& values) {
+        values.resize(static_cast<size_t>(receiveValue<int64_t>()));
+        if (!values.empty()) receive(&values[0], values.size()*sizeof(T));
+    }
+    
+private:
+    SocketChannel(const SocketChannel&);
+    SocketChannel& operator=(const SocketChannel&);
+    
+    int socketDescriptor_;
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STORAGEARRAY_H
+#define STORAGEARRAY_H
+
+#include <vector>
+#include <cstddef>
+
+// Array which either owns its elements or refers to elements stored elsewhere (e.g. in a MappedFile)
+template <typename T>
+class StorageArray {
+public:
+    StorageArray() : data_(NULL), size_(0) {}
+    
+    void resize(const size_t size) {
+        ownedData_.resize(size);
+        data_ = ownedData_.empty() ? NULL : &ownedData_[0];
+        size_ = size;
+    }
+    void setView(const T* data, const size_t size) {
+        std::vector<T>().swap(ownedData_);
+        data_ = data;
+        size_ = size;
+    }
+    void clear() {
+        std::vector<T>().swap(ownedData_);
+        data_ = NULL;
+        size_ = 0;
+    }
+    
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* data() const { return data_; }
+    const T& operator[](const size_t index) const { return data_[index]; }
+    // Only for owned elements
+    T* mutableData() { return ownedData_.empty() ? NULL : &ownedData_[0]; }
+    
+private:
+    // A copy of owned elements would still refer to those of the original
+    StorageArray(const StorageArray&);
+    StorageArray& operator=(const StorageArray&);
+    
+    std::vector<T> ownedData_;
+    const T* data_;
+    size_t size_;
+};
+
+#endif
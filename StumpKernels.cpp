@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "StumpKernels.h"
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STUMPKERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Samples are processed in blocks, so that the scores of a block stay in L1 cache while all stumps are added
+static const int sampleBlockSize = 256;
+
+typedef void (*StumpBlockKernel)(const StumpArrays& stumps,
+                                 const double* samples,
+                                 const int sampleTotal,
+                                 const long long sampleStride,
+                                 const long long featureStride,
+                                 double* scores);
+
+static void addStumpOutputsScalar(const StumpArrays& stumps,
+                                  const double* samples,
+                                  const int sampleTotal,
+                                  const long long sampleStride,
+                                  const long long featureStride,
+                                  double* scores)
+{
+    for (int stumpIndex = 0; stumpIndex < stumps.stumpTotal; ++stumpIndex) {
+        const double* featureValues = samples + stumps.featureIndices[stumpIndex]*featureStride;
+        double threshold = stumps.thresholds[stumpIndex];
+        double outputLarger = stumps.outputsLarger[stumpIndex];
+        double outputSmaller = stumps.outputsSmaller[stumpIndex];
+        for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+            if (featureValues[sampleIndex*sampleStride] > threshold) scores[sampleIndex] += outputLarger;
+            else scores[sampleIndex] += outputSmaller;
+        }
+    }
+}
+
+#ifdef STUMPKERNELS_X86
+
+__attribute__((target("avx2")))
+static void addStumpOutputsAVX2(const StumpArrays& stumps,
+                                const double* samples,
+                                const int sampleTotal,
+                                const long long sampleStride,
+                                const long long featureStride,
+                                double* scores)
+{
+    const int vectorSampleTotal = sampleTotal/4*4;
+    const __m256i sampleOffsets = _mm256_set_epi64x(3*sampleStride, 2*sampleStride, sampleStride, 0);
+    
+    for (int stumpIndex = 0; stumpIndex < stumps.stumpTotal; ++stumpIndex) {
+        const double* featureValues = samples + stumps.featureIndices[stumpIndex]*featureStride;
+        __m256d threshold = _mm256_set1_pd(stumps.thresholds[stumpIndex]);
+        __m256d outputLarger = _mm256_set1_pd(stumps.outputsLarger[stumpIndex]);
+        __m256d outputSmaller = _mm256_set1_pd(stumps.outputsSmaller[stumpIndex]);
+        
+        for (int sampleIndex = 0; sampleIndex < vectorSampleTotal; sampleIndex += 4) {
+            __m256d values;
+            if (sampleStride == 1) {
+                values = _mm256_loadu_pd(featureValues + sampleIndex);
+            } else {
+                values = _mm256_i64gather_pd(featureValues + sampleIndex*sampleStride, sampleOffsets, 8);
+            }
+            __m256d larger = _mm256_cmp_pd(values, threshold, _CMP_GT_OQ);
+            __m256d outputs = _mm256_blendv_pd(outputSmaller, outputLarger, larger);
+            _mm256_storeu_pd(scores + sampleIndex, _mm256_add_pd(_mm256_loadu_pd(scores + sampleIndex), outputs));
+        }
+    }
+    
+    if (vectorSampleTotal < sampleTotal) {
+        addStumpOutputsScalar(stumps, samples + vectorSampleTotal*sampleStride, sampleTotal - vectorSampleTotal,
+                              sampleStride, featureStride, scores + vectorSampleTotal);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void addStumpOutputsAVX512(const StumpArrays& stumps,
+                                  const double* samples,
+                                  const int sampleTotal,
+                                  const long long sampleStride,
+                                  const long long featureStride,
+                                  double* scores)
+{
+    const int vectorSampleTotal = sampleTotal/8*8;
+    const __m512i sampleOffsets = _mm512_set_epi64(7*sampleStride, 6*sampleStride, 5*sampleStride, 4*sampleStride,
+                                                   3*sampleStride, 2*sampleStride, sampleStride, 0);
+    
+    for (int stumpIndex = 0; stumpIndex < stumps.stumpTotal; ++stumpIndex) {
+        const double* featureValues = samples + stumps.featureIndices[stumpIndex]*featureStride;
+        __m512d threshold = _mm512_set1_pd(stumps.thresholds[stumpIndex]);
+        __m512d outputLarger = _mm512_set1_pd(stumps.outputsLarger[stumpIndex]);
+        __m512d outputSmaller = _mm512_set1_pd(stumps.outputsSmaller[stumpIndex]);
+        
+        for (int sampleIndex = 0; sampleIndex < vectorSampleTotal; sampleIndex += 8) {
+            __m512d values;
+            if (sampleStride == 1) {
+                values = _mm512_loadu_pd(featureValues + sampleIndex);
+            } else {
+                values = _mm512_i64gather_pd(sampleOffsets, featureValues + sampleIndex*sampleStride, 8);
+            }
+            __mmask8 larger = _mm512_cmp_pd_mask(values, threshold, _CMP_GT_OQ);
+            __m512d outputs = _mm512_mask_blend_pd(larger, outputSmaller, outputLarger);
+            _mm512_storeu_pd(scores + sampleIndex, _mm512_add_pd(_mm512_loadu_pd(scores + sampleIndex), outputs));
+        }
+    }
+    
+    if (vectorSampleTotal < sampleTotal) {
+        addStumpOutputsScalar(stumps, samples + vectorSampleTotal*sampleStride, sampleTotal - vectorSampleTotal,
+                              sampleStride, featureStride, scores + vectorSampleTotal);
+    }
+}
+
+#endif
+
+static StumpBlockKernel selectStumpBlockKernel() {
+#ifdef STUMPKERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return addStumpOutputsAVX512;
+    if (__builtin_cpu_supports("avx2")) return addStumpOutputsAVX2;
+#endif
+    return addStumpOutputsScalar;
+}
+
+void addStumpOutputs(const StumpArrays& stumps,
+                     const double* samples,
+                     const int sampleTotal,
+                     const long long sampleStride,
+                     const long long featureStride,
+                     double* scores)
+{
+    static const StumpBlockKernel blockKernel = selectStumpBlockKernel();
+    
+    for (int blockBegin = 0; blockBegin < sampleTotal; blockBegin += sampleBlockSize) {
+        int blockSampleTotal = sampleTotal - blockBegin;
+        if (blockSampleTotal > sampleBlockSize) blockSampleTotal = sampleBlockSize;
+        blockKernel(stumps, samples + blockBegin*sampleStride, blockSampleTotal, sampleStride, featureStride,
+                    scores + blockBegin);
+    }
+}
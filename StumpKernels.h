@@ -0,0 +1,51 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STUMPKERNELS_H
+#define STUMPKERNELS_H
+
+// Decision stumps stored as separate arrays in round order
+struct StumpArrays {
+    int stumpTotal;
+    const int* featureIndices;
+    const double* thresholds;
+    const double* outputsLarger;
+    const double* outputsSmaller;
+};
+
+// Adds the outputs of all stumps, in round order, to scores[0, sampleTotal)
+// Feature d of sample i is samples[i*sampleStride + d*featureStride].
+// An AVX-512 or AVX2 kernel is chosen at runtime if the CPU supports it; all kernels give the same
+// results as adding DecisionStump outputs one by one.
+void addStumpOutputs(const StumpArrays& stumps,
+                     const double* samples,
+                     const int sampleTotal,
+                     const long long sampleStride,
+                     const long long featureStride,
+                     double* scores);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SyntheticData.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+// Features whose mean depends on the label
+static const int informativeFeatureTotal = 10;
+// Common values of ties: multiples of tieValueStep in [-tieValueTotal/2, tieValueTotal/2)*tieValueStep
+static const int tieValueTotal = 16;
+static const double tieValueStep = 0.25;
+
+// Uniform value in (0, 1) from one output of the generator
+static double uniformValue(std::mt19937& generator) {
+    return (static_cast<double>(generator()) + 0.5)/4294967296.0;
+}
+
+// Standard normal value (Box-Muller transform)
+static double normalValue(std::mt19937& generator) {
+    double radius = sqrt(-2.0*log(uniformValue(generator)));
+    return radius*cos(2.0*M_PI*uniformValue(generator));
+}
+
+void writeSyntheticDataFile(const std::string& filename, const SyntheticDataParameters& parameters) {
+    FILE* dataFile = fopen(filename.c_str(), "w");
+    if (dataFile == NULL) {
+        std::cerr << "error: can't open file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    std::mt19937 generator(parameters.seed);
+    for (int sampleIndex = 0; sampleIndex < parameters.sampleTotal; ++sampleIndex) {
+        bool positive = uniformValue(generator) < parameters.positiveRate;
+        fputs(positive ? "+1" : "-1", dataFile);
+        
+        for (int featureIndex = 0; featureIndex < parameters.featureTotal; ++featureIndex) {
+            // The same number of draws for every value, so that each value depends only on its position
+            double zeroDraw = uniformValue(generator);
+            double tieDraw = uniformValue(generator);
+            double value = normalValue(generator);
+            if (zeroDraw < parameters.zeroRate) continue;
+            
+            if (featureIndex < informativeFeatureTotal) {
+                value += (positive ? 0.5 : -0.5)/(featureIndex + 1);
+            }
+            if (tieDraw < parameters.tieRate) {
+                int tieIndex = static_cast<int>(floor(value/tieValueStep));
+                tieIndex = std::max(std::min(tieIndex, tieValueTotal/2 - 1), -tieValueTotal/2);
+                value = tieIndex*tieValueStep;
+            }
+            if (value == 0) continue;
+            
+            fprintf(dataFile, " %d:%.6g", featureIndex + 1, value);
+        }
+        fputc('\n', dataFile);
+    }
+    
+    if (fclose(dataFile) != 0) {
+        std::cerr << "error: can't write file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+}
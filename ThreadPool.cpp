@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ThreadPool.h"
+#include <iostream>
+#include <cstdlib>
+
+ThreadPool::ThreadPool(const int threadTotal)
+    : threadTotal_(threadTotal), generation_(0), runningTotal_(0), stopping_(false), task_(NULL),
+      rangeEnds_(threadTotal > 0 ? threadTotal : 1), nextTasks_(threadTotal > 0 ? threadTotal : 1)
+{
+    if (threadTotal_ < 1) {
+        std::cerr << "error: invalid number of threads" << std::endl;
+        exit(1);
+    }
+    
+    for (int threadIndex = 1; threadIndex < threadTotal_; ++threadIndex) {
+        workers_.push_back(std::thread(&ThreadPool::workerLoop, this, threadIndex));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    startCondition_.notify_all();
+    for (int workerIndex = 0; workerIndex < static_cast<int>(workers_.size()); ++workerIndex) {
+        workers_[workerIndex].join();
+    }
+}
+
+void ThreadPool::run(const int taskTotal, const std::function<void (int, int)>& task) {
+    if (taskTotal <= 0) return;
+    
+    if (threadTotal_ == 1 || taskTotal == 1) {
+        for (int taskIndex = 0; taskIndex < taskTotal; ++taskIndex) task(taskIndex, 0);
+        return;
+    }
+    
+    for (int threadIndex = 0; threadIndex < threadTotal_; ++threadIndex) {
+        int rangeBegin = static_cast<int>(static_cast<long long>(taskTotal)*threadIndex/threadTotal_);
+        rangeEnds_[threadIndex] = static_cast<int>(static_cast<long long>(taskTotal)*(threadIndex + 1)/threadTotal_);
+        nextTasks_[threadIndex].store(rangeBegin);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        runningTotal_ = threadTotal_ - 1;
+        ++generation_;
+    }
+    startCondition_.notify_all();
+    
+    processTasks(0);
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (runningTotal_ > 0) finishCondition_.wait(lock);
+    task_ = NULL;
+}
+
+void ThreadPool::workerLoop(const int threadIndex) {
+    unsigned long long processedGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_ && generation_ == processedGeneration) startCondition_.wait(lock);
+            if (stopping_) return;
+            processedGeneration = generation_;
+        }
+        
+        processTasks(threadIndex);
+        
+        bool lastWorker;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --runningTotal_;
+            lastWorker = (runningTotal_ == 0);
+        }
+        if (lastWorker) finishCondition_.notify_one();
+    }
+}
+
+void ThreadPool::processTasks(const int threadIndex) {
+    // Own range first, then steal from the other ranges
+    for (int offset = 0; offset < threadTotal_; ++offset) {
+        int victimIndex = (threadIndex + offset)%threadTotal_;
+        while (true) {
+            int taskIndex = nextTasks_[victimIndex].fetch_add(1);
+            if (taskIndex >= rangeEnds_[victimIndex]) break;
+            (*task_)(taskIndex, threadIndex);
+        }
+    }
+}
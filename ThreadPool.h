@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Fixed set of worker threads executing parallel loops over task indices.
+// The calling thread takes part as thread 0, so a pool of one thread runs everything inline.
+// Tasks are split into one contiguous range per thread; a thread that has finished its own range
+// steals the remaining tasks of the other ranges.
+class ThreadPool {
+public:
+    explicit ThreadPool(const int threadTotal = 1);
+    ~ThreadPool();
+    
+    int threadTotal() const { return threadTotal_; }
+    
+    // Calls task(taskIndex, threadIndex) for every taskIndex in [0, taskTotal) and waits for completion
+    void run(const int taskTotal, const std::function<void (int, int)>& task);
+    
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+    
+    void workerLoop(const int threadIndex);
+    void processTasks(const int threadIndex);
+    
+    int threadTotal_;
+    std::vector<std::thread> workers_;
+    
+    std::mutex mutex_;
+    std::condition_variable startCondition_;
+    std::condition_variable finishCondition_;
+    unsigned long long generation_;
+    int runningTotal_;
+    bool stopping_;
+    
+    // Current job
+    const std::function<void (int, int)>* task_;
+    std::vector<int> rangeEnds_;
+    std::vector< std::atomic<int> > nextTasks_;
+};
+
+#endif
@@ -0,0 +1,519 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "AdaBoost.h"
+#include "readSampleDataFile.h"
+#include "SyntheticData.h"
+#include "Profiler.h"
+
+// Rounds timed one by one for the time of a single round (the median is reported)
+const int singleRoundTotal = 5;
+// A benchmark is reported as slower (or as using more memory) if it takes this much more time
+// (or peak RSS) than in the baseline
+const double slowdownTolerance = 0.1;
+
+struct ParameterABBench {
+    SyntheticDataParameters data;
+    int roundTotal;
+    int threadTotal;
+    int repeatTotal;
+    std::string dataFilename;
+    bool generateOnly;
+    std::string outputResultFilename;
+    std::string baselineFilename;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    double seconds;
+    // Items processed per second; the item is given by unit
+    double throughput;
+    std::string unit;
+    // Peak resident set size of a process which runs only this benchmark
+    long long peakResidentKilobytes;
+};
+
+// Prototype declaration
+void exitWithUsage();
+ParameterABBench parseCommandline(int argc, char* argv[]);
+std::string configurationText(const ParameterABBench& parameters);
+void addResult(const std::string& name, const double seconds, const double itemTotal, const std::string& unit,
+               std::vector<BenchmarkResult>& results);
+void runIsolated(const std::function<void (std::vector<BenchmarkResult>&)>& benchmark,
+                 std::vector<BenchmarkResult>& results);
+void runBenchmarks(const ParameterABBench& parameters, std::vector<BenchmarkResult>& results);
+void writeResults(const std::string& filename, const ParameterABBench& parameters, const std::vector<BenchmarkResult>& results);
+void printResults(const ParameterABBench& parameters, const std::vector<BenchmarkResult>& results);
+
+void exitWithUsage() {
+    std::cerr << "usage: abbench [options] [baseline_file]" << std::endl;
+    std::cerr << "options:" << std::endl;
+    std::cerr << "   -n: the number of samples [default:20000]" << std::endl;
+    std::cerr << "   -d: the number of features [default:100]" << std::endl;
+    std::cerr << "   -z: fraction of zero values (0-1) [default:0.5]" << std::endl;
+    std::cerr << "   -u: fraction of nonzero values taken from a few common values, i.e. ties (0-1) [default:0.3]" << std::endl;
+    std::cerr << "   -c: fraction of positive samples (0-1) [default:0.5]" << std::endl;
+    std::cerr << "   --seed: random seed of the data [default:0]" << std::endl;
+    std::cerr << "   -r: the number of rounds of full training [default:20]" << std::endl;
+    std::cerr << "   -j: the number of threads [default:1]" << std::endl;
+    std::cerr << "   -m: the number of repetitions, the fastest is reported [default:3]" << std::endl;
+    std::cerr << "   -w: data file written and used by the benchmarks [default:abbench.data]" << std::endl;
+    std::cerr << "   -g: only write the data file" << std::endl;
+    std::cerr << "   -o: output result file, which can be used as a baseline" << std::endl;
+    
+    exit(1);
+}
+
+ParameterABBench parseCommandline(int argc, char* argv[]) {
+    ParameterABBench parameters;
+    parameters.data.sampleTotal = 20000;
+    parameters.data.featureTotal = 100;
+    parameters.data.zeroRate = 0.5;
+    parameters.data.tieRate = 0.3;
+    parameters.data.positiveRate = 0.5;
+    parameters.data.seed = 0;
+    parameters.roundTotal = 20;
+    parameters.threadTotal = 1;
+    parameters.repeatTotal = 3;
+    parameters.dataFilename = "abbench.data";
+    parameters.generateOnly = false;
+    parameters.outputResultFilename = "";
+    parameters.baselineFilename = "";
+    
+    // Options
+    int argIndex;
+    for (argIndex = 1; argIndex < argc; ++argIndex) {
+        if (argv[argIndex][0] != '-') break;
+        
+        if (strcmp(argv[argIndex], "--seed") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.data.seed = static_cast<unsigned int>(strtoul(argv[argIndex], NULL, 10));
+            continue;
+        }
+        
+        char option = argv[argIndex][1];
+        if (option == 'g') {
+            parameters.generateOnly = true;
+            continue;
+        }
+        
+        ++argIndex;
+        if (argIndex >= argc) exitWithUsage();
+        switch (option) {
+            case 'n':
+            case 'd':
+            case 'r':
+            case 'j':
+            case 'm':
+            {
+                int value = atoi(argv[argIndex]);
+                if (value < 1) {
+                    std::cerr << "error: invalid number (-" << option << ")" << std::endl;
+                    exitWithUsage();
+                }
+                if (option == 'n') parameters.data.sampleTotal = value;
+                else if (option == 'd') parameters.data.featureTotal = value;
+                else if (option == 'r') parameters.roundTotal = value;
+                else if (option == 'j') parameters.threadTotal = value;
+                else parameters.repeatTotal = value;
+                break;
+            }
+            case 'z':
+            case 'u':
+            case 'c':
+            {
+                double rate = atof(argv[argIndex]);
+                if (rate < 0 || rate > 1) {
+                    std::cerr << "error: invalid fraction (-" << option << ")" << std::endl;
+                    exitWithUsage();
+                }
+                if (option == 'z') parameters.data.zeroRate = rate;
+                else if (option == 'u') parameters.data.tieRate = rate;
+                else parameters.data.positiveRate = rate;
+                break;
+            }
+            case 'w':
+                parameters.dataFilename = argv[argIndex];
+                break;
+            case 'o':
+                parameters.outputResultFilename = argv[argIndex];
+                break;
+            default:
+                std::cerr << "error: undefined option" << std::endl;
+                exitWithUsage();
+                break;
+        }
+    }
+    
+    // Baseline file
+    if (argIndex < argc) parameters.baselineFilename = argv[argIndex];
+    
+    return parameters;
+}
+
+std::string configurationText(const ParameterABBench& parameters) {
+    std::ostringstream configurationStream;
+    configurationStream << "n=" << parameters.data.sampleTotal << " d=" << parameters.data.featureTotal;
+    configurationStream << " z=" << parameters.data.zeroRate << " u=" << parameters.data.tieRate;
+    configurationStream << " c=" << parameters.data.positiveRate << " seed=" << parameters.data.seed;
+    configurationStream << " r=" << parameters.roundTotal << " j=" << parameters.threadTotal;
+    return configurationStream.str();
+}
+
+void addResult(const std::string& name, const double seconds, const double itemTotal, const std::string& unit,
+               std::vector<BenchmarkResult>& results)
+{
+    BenchmarkResult result;
+    result.name = name;
+    result.seconds = seconds;
+    result.throughput = (seconds > 0) ? itemTotal/seconds : 0.0;
+    result.unit = unit;
+    result.peakResidentKilobytes = Profiler::peakResidentKilobytes();
+    results.push_back(result);
+}
+
+// Runs a benchmark in a forked process, so that the peak RSS of its results doesn't include the memory of
+// the benchmarks before it. The results are sent back through a pipe as lines of the result file.
+void runIsolated(const std::function<void (std::vector<BenchmarkResult>&)>& benchmark,
+                 std::vector<BenchmarkResult>& results)
+{
+    int pipeDescriptors[2];
+    if (pipe(pipeDescriptors) != 0) {
+        std::cerr << "error: can't create a pipe for a benchmark process" << std::endl;
+        exit(1);
+    }
+    std::cout.flush();
+    pid_t processId = fork();
+    if (processId < 0) {
+        std::cerr << "error: can't start a benchmark process" << std::endl;
+        exit(1);
+    }
+    if (processId == 0) {
+        close(pipeDescriptors[0]);
+        std::vector<BenchmarkResult> benchmarkResults;
+        benchmark(benchmarkResults);
+
+        std::ostringstream resultStream;
+        resultStream << std::setprecision(17);
+        for (int resultIndex = 0; resultIndex < static_cast<int>(benchmarkResults.size()); ++resultIndex) {
+            resultStream << benchmarkResults[resultIndex].name << " " << benchmarkResults[resultIndex].seconds << " ";
+            resultStream << benchmarkResults[resultIndex].throughput << " " << benchmarkResults[resultIndex].unit << " ";
+            resultStream << benchmarkResults[resultIndex].peakResidentKilobytes << std::endl;
+        }
+        std::string resultText = resultStream.str();
+        size_t writtenSize = 0;
+        while (writtenSize < resultText.size()) {
+            ssize_t writeSize = write(pipeDescriptors[1], resultText.data() + writtenSize, resultText.size() - writtenSize);
+            if (writeSize < 0 && errno == EINTR) continue;
+            if (writeSize <= 0) _exit(1);
+            writtenSize += writeSize;
+        }
+        _exit(0);
+    }
+    close(pipeDescriptors[1]);
+
+    std::string resultText;
+    char buffer[4096];
+    while (true) {
+        ssize_t readSize = read(pipeDescriptors[0], buffer, sizeof(buffer));
+        if (readSize < 0 && errno == EINTR) continue;
+        if (readSize <= 0) break;
+        resultText.append(buffer, readSize);
+    }
+    close(pipeDescriptors[0]);
+    int processStatus;
+    if (waitpid(processId, &processStatus, 0) < 0 || !WIFEXITED(processStatus) || WEXITSTATUS(processStatus) != 0) {
+        std::cerr << "error: benchmark process failed" << std::endl;
+        exit(1);
+    }
+
+    std::istringstream resultStream(resultText);
+    BenchmarkResult result;
+    while (resultStream >> result.name >> result.seconds >> result.throughput >> result.unit >> result.peakResidentKilobytes) {
+        results.push_back(result);
+    }
+}
+
+void runBenchmarks(const ParameterABBench& parameters, std::vector<BenchmarkResult>& results) {
+    int sampleTotal = parameters.data.sampleTotal;
+    double valueTotal = static_cast<double>(sampleTotal)*parameters.data.featureTotal;
+    // The gentle model is written by its training benchmark and read by the prediction benchmarks
+    std::string modelFilename = parameters.dataFilename + ".model";
+
+    // Loading: parsing of the text file
+    runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+        double loadSeconds = 0.0;
+        for (int repeatIndex = 0; repeatIndex < parameters.repeatTotal; ++repeatIndex) {
+            SparseSampleData samples;
+            std::vector<bool> sampleLabels;
+            double beginTime = Profiler::now();
+            readSampleDataFile(parameters.dataFilename, samples, sampleLabels, parameters.threadTotal);
+            double seconds = Profiler::now() - beginTime;
+            if (repeatIndex == 0 || seconds < loadSeconds) loadSeconds = seconds;
+        }
+        addResult("load", loadSeconds, sampleTotal, "samples/s", benchmarkResults);
+    }, results);
+    double loadSeconds = results.back().seconds;
+
+    // Presort: setTrainingSamples parses and sorts, the parse time is subtracted
+    runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+        double setupSeconds = 0.0;
+        for (int repeatIndex = 0; repeatIndex < parameters.repeatTotal; ++repeatIndex) {
+            AdaBoost adaBoost;
+            adaBoost.setThreadTotal(parameters.threadTotal);
+            double beginTime = Profiler::now();
+            adaBoost.setTrainingSamples(parameters.dataFilename);
+            double seconds = Profiler::now() - beginTime;
+            if (repeatIndex == 0 || seconds < setupSeconds) setupSeconds = seconds;
+        }
+        addResult("presort", std::max(setupSeconds - loadSeconds, 0.0), valueTotal, "values/s", benchmarkResults);
+    }, results);
+
+    // Single round: median of the first rounds of gentle AdaBoost
+    runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+        AdaBoost adaBoost;
+        adaBoost.setThreadTotal(parameters.threadTotal);
+        adaBoost.setTrainingSamples(parameters.dataFilename);
+        std::vector<double> roundSeconds;
+        for (int roundIndex = 0; roundIndex < singleRoundTotal; ++roundIndex) {
+            double beginTime = Profiler::now();
+            adaBoost.train(roundIndex + 1);
+            roundSeconds.push_back(Profiler::now() - beginTime);
+        }
+        std::sort(roundSeconds.begin(), roundSeconds.end());
+        addResult("round", roundSeconds[singleRoundTotal/2], valueTotal, "values/s", benchmarkResults);
+    }, results);
+
+    // Full training for each boosting type
+    const char* boostingTypeNames[3] = { "train_discrete", "train_real", "train_gentle" };
+    for (int boostingType = 0; boostingType < 3; ++boostingType) {
+        runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+            AdaBoost adaBoost;
+            adaBoost.setBoostingType(boostingType);
+            adaBoost.setThreadTotal(parameters.threadTotal);
+            adaBoost.setTrainingSamples(parameters.dataFilename);
+            double beginTime = Profiler::now();
+            adaBoost.train(parameters.roundTotal);
+            addResult(boostingTypeNames[boostingType], Profiler::now() - beginTime, parameters.roundTotal, "rounds/s",
+                      benchmarkResults);
+            if (boostingType == 2) adaBoost.writeFile(modelFilename);
+        }, results);
+    }
+
+    // Prediction with the gentle model
+    runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+        AdaBoost adaBoost;
+        adaBoost.readFile(modelFilename);
+        std::vector< std::vector<double> > sampleFeatures;
+        std::vector<bool> sampleLabels;
+        readSampleDataFile(parameters.dataFilename, sampleFeatures, sampleLabels, parameters.threadTotal);
+        std::vector<double> scores(sampleTotal);
+        double predictSeconds = 0.0;
+        for (int repeatIndex = 0; repeatIndex < parameters.repeatTotal; ++repeatIndex) {
+            double beginTime = Profiler::now();
+            for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+                scores[sampleIndex] = adaBoost.predict(sampleFeatures[sampleIndex]);
+            }
+            double seconds = Profiler::now() - beginTime;
+            if (repeatIndex == 0 || seconds < predictSeconds) predictSeconds = seconds;
+        }
+        addResult("predict", predictSeconds, sampleTotal, "samples/s", benchmarkResults);
+    }, results);
+
+    // The block is filled from the sparse samples, so that dense vectors don't add to the peak RSS
+    runIsolated([&](std::vector<BenchmarkResult>& benchmarkResults) {
+        AdaBoost adaBoost;
+        adaBoost.readFile(modelFilename);
+        int featureDimension = adaBoost.featureDimension();
+        std::vector<double> sampleBlock(static_cast<size_t>(sampleTotal)*featureDimension, 0.0);
+        {
+            SparseSampleData samples;
+            std::vector<bool> sampleLabels;
+            readSampleDataFile(parameters.dataFilename, samples, sampleLabels, parameters.threadTotal);
+            for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+                for (long long elementIndex = samples.sampleOffsets[sampleIndex];
+                     elementIndex < samples.sampleOffsets[sampleIndex + 1]; ++elementIndex)
+                {
+                    int featureIndex = samples.featureIndices[elementIndex];
+                    if (featureIndex >= featureDimension) continue;
+                    sampleBlock[static_cast<size_t>(sampleIndex)*featureDimension + featureIndex] = samples.featureValues[elementIndex];
+                }
+            }
+        }
+        std::vector<double> scores(sampleTotal);
+        double predictBatchSeconds = 0.0;
+        for (int repeatIndex = 0; repeatIndex < parameters.repeatTotal; ++repeatIndex) {
+            double beginTime = Profiler::now();
+            adaBoost.predictBatch(sampleBlock.data(), sampleTotal, featureDimension, AdaBoost::RowMajor, scores.data());
+            double seconds = Profiler::now() - beginTime;
+            if (repeatIndex == 0 || seconds < predictBatchSeconds) predictBatchSeconds = seconds;
+        }
+        addResult("predict_batch", predictBatchSeconds, sampleTotal, "samples/s", benchmarkResults);
+    }, results);
+
+    remove(modelFilename.c_str());
+}
+
+void writeResults(const std::string& filename, const ParameterABBench& parameters, const std::vector<BenchmarkResult>& results) {
+    std::ofstream resultStream(filename.c_str(), std::ios_base::out);
+    if (resultStream.fail()) {
+        std::cerr << "error: can't open file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+    
+    resultStream << "# " << configurationText(parameters) << std::endl;
+    resultStream << "# name seconds throughput unit peak_rss_kb (of a process running only the benchmark)" << std::endl;
+    resultStream << std::setprecision(9);
+    for (int resultIndex = 0; resultIndex < static_cast<int>(results.size()); ++resultIndex) {
+        resultStream << results[resultIndex].name << " " << results[resultIndex].seconds << " ";
+        resultStream << results[resultIndex].throughput << " " << results[resultIndex].unit << " ";
+        resultStream << results[resultIndex].peakResidentKilobytes << std::endl;
+    }
+    
+    resultStream.close();
+    if (resultStream.fail()) {
+        std::cerr << "error: can't write file (" << filename << ")" << std::endl;
+        exit(1);
+    }
+}
+
+void printResults(const ParameterABBench& parameters, const std::vector<BenchmarkResult>& results) {
+    // Baseline seconds and peak RSS by benchmark name, from a result file of an earlier run
+    // (the peak RSS is 0 if the baseline doesn't have it)
+    std::map<std::string, double> baselineSeconds;
+    std::map<std::string, long long> baselineResidentKilobytes;
+    if (!parameters.baselineFilename.empty()) {
+        std::ifstream baselineStream(parameters.baselineFilename.c_str(), std::ios_base::in);
+        if (baselineStream.fail()) {
+            std::cerr << "error: can't open file (" << parameters.baselineFilename << ")" << std::endl;
+            exit(1);
+        }
+        std::string line;
+        while (std::getline(baselineStream, line)) {
+            if (line.empty()) continue;
+            if (line[0] == '#') {
+                if (line.compare(0, 4, "# n=") == 0 && line.substr(2) != configurationText(parameters)) {
+                    std::cerr << "warning: the baseline was measured with other settings (" << line.substr(2) << ")" << std::endl;
+                }
+                continue;
+            }
+            std::istringstream lineStream(line);
+            std::string name;
+            double seconds;
+            if (!(lineStream >> name >> seconds)) continue;
+            baselineSeconds[name] = seconds;
+            double throughput;
+            std::string unit;
+            long long peakResidentKilobytes;
+            if (lineStream >> throughput >> unit >> peakResidentKilobytes) {
+                baselineResidentKilobytes[name] = peakResidentKilobytes;
+            }
+        }
+    }
+    
+    std::cout << configurationText(parameters) << std::endl;
+    std::cout << std::left << std::setw(16) << "benchmark" << std::right << std::setw(12) << "seconds";
+    std::cout << std::setw(16) << "throughput" << "  " << std::left << std::setw(10) << "unit";
+    std::cout << std::right << std::setw(12) << "peak RSS KB";
+    if (!baselineSeconds.empty()) std::cout << std::setw(12) << "baseline";
+    if (!baselineResidentKilobytes.empty()) std::cout << std::setw(12) << "memory";
+    std::cout << std::endl;
+    
+    int slowerTotal = 0;
+    int largerTotal = 0;
+    for (int resultIndex = 0; resultIndex < static_cast<int>(results.size()); ++resultIndex) {
+        const BenchmarkResult& result = results[resultIndex];
+        std::cout << std::left << std::setw(16) << result.name << std::right;
+        std::cout << std::setw(12) << std::setprecision(4) << result.seconds;
+        std::cout << std::setw(16) << std::setprecision(6) << result.throughput << "  ";
+        std::cout << std::left << std::setw(10) << result.unit << std::right;
+        std::cout << std::setw(12) << result.peakResidentKilobytes;
+        
+        // The flags follow the ratio columns, so that they stay aligned
+        std::string flagText;
+        std::map<std::string, double>::const_iterator baselineIterator = baselineSeconds.find(result.name);
+        if (baselineIterator != baselineSeconds.end() && baselineIterator->second > 0) {
+            // Time relative to the baseline (above 1: slower)
+            double ratio = result.seconds/baselineIterator->second;
+            std::cout << std::setw(11) << std::setprecision(3) << ratio << "x";
+            if (ratio > 1.0 + slowdownTolerance) {
+                flagText += "  slower";
+                ++slowerTotal;
+            }
+        }
+        std::map<std::string, long long>::const_iterator residentIterator = baselineResidentKilobytes.find(result.name);
+        if (residentIterator != baselineResidentKilobytes.end() && residentIterator->second > 0) {
+            // Peak RSS relative to the baseline (above 1: more memory)
+            double ratio = static_cast<double>(result.peakResidentKilobytes)/residentIterator->second;
+            std::cout << std::setw(11) << std::setprecision(3) << ratio << "x";
+            if (ratio > 1.0 + slowdownTolerance) {
+                flagText += "  more memory";
+                ++largerTotal;
+            }
+        }
+        std::cout << flagText;
+        std::cout << std::endl;
+    }
+    if (!baselineSeconds.empty()) {
+        std::cout << slowerTotal << " benchmark(s) slower than the baseline by more than ";
+        std::cout << slowdownTolerance*100 << "%" << std::endl;
+    }
+    if (!baselineResidentKilobytes.empty()) {
+        std::cout << largerTotal << " benchmark(s) using more memory than the baseline by more than ";
+        std::cout << slowdownTolerance*100 << "%" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ParameterABBench parameters = parseCommandline(argc, argv);
+    
+    writeSyntheticDataFile(parameters.dataFilename, parameters.data);
+    if (parameters.generateOnly) return 0;
+    
+    std::vector<BenchmarkResult> results;
+    runBenchmarks(parameters, results);
+    
+    if (!parameters.outputResultFilename.empty()) writeResults(parameters.outputResultFilename, parameters, results);
+    printResults(parameters, results);
+}
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "AdaBoost.h"
+
+struct ParameterABConvert {
+    bool verbose;
+    std::string trainingDataFilename;
+    std::string outputSampleFilename;
+    bool sparseTraining;
+    int threadTotal;
+};
+
+// Prototype declaration
+void exitWithUsage();
+ParameterABConvert parseCommandline(int argc, char* argv[]);
+
+void exitWithUsage() {
+    std::cerr << "usage: abconvert [options] training_set_file [sample_file]" << std::endl;
+    std::cerr << "options:" << std::endl;
+    std::cerr << "   -s: sparse (only nonzero values are stored)" << std::endl;
+    std::cerr << "   -j: the number of threads [default:1]" << std::endl;
+    std::cerr << "   -v: verbose" << std::endl;
+    
+    exit(1);
+}
+
+ParameterABConvert parseCommandline(int argc, char* argv[]) {
+    ParameterABConvert parameters;
+    parameters.verbose = false;
+    parameters.sparseTraining = false;
+    parameters.threadTotal = 1;
+    
+    // Options
+    int argIndex;
+    for (argIndex = 1; argIndex < argc; ++argIndex) {
+        if (argv[argIndex][0] != '-') break;
+        
+        switch (argv[argIndex][1]) {
+            case 'v':
+                parameters.verbose = true;
+                break;
+            case 's':
+                parameters.sparseTraining = true;
+                break;
+            case 'j':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int threadTotal = atoi(argv[argIndex]);
+                if (threadTotal < 1) {
+                    std::cerr << "error: invalid number of threads" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.threadTotal = threadTotal;
+                break;
+            }
+            default:
+                std::cerr << "error: undefined option" << std::endl;
+                exitWithUsage();
+                break;
+        }
+    }
+    
+    // Training data file
+    if (argIndex >= argc) exitWithUsage();
+    parameters.trainingDataFilename = argv[argIndex];
+    
+    // Sample file
+    ++argIndex;
+    if (argIndex >= argc) parameters.outputSampleFilename = parameters.trainingDataFilename + ".abs";
+    else parameters.outputSampleFilename = argv[argIndex];
+    
+    return parameters;
+}
+
+int main(int argc, char* argv[]) {
+    ParameterABConvert parameters = parseCommandline(argc, argv);
+    
+    if (parameters.verbose) {
+        std::cerr << std::endl;
+        std::cerr << "Traing data:   " << parameters.trainingDataFilename << std::endl;
+        std::cerr << "Output sample: " << parameters.outputSampleFilename << std::endl;
+        if (parameters.sparseTraining) std::cerr << "   Sparse" << std::endl;
+        std::cerr << std::endl;
+    }
+    
+    AdaBoost adaBoost;
+    adaBoost.setThreadTotal(parameters.threadTotal);
+    adaBoost.setSparseTraining(parameters.sparseTraining);
+    adaBoost.setTrainingSamples(parameters.trainingDataFilename);
+    
+    adaBoost.writeTrainingSampleFile(parameters.outputSampleFilename);
+}
@@ -0,0 +1,272 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "readSampleDataFile.h"
+#include "AdaBoost.h"
+
+struct ParameterABExport {
+    bool verbose;
+    bool groupByFeature;
+    std::string name;
+    std::string modelFilename;
+    std::string headerFilename;
+    std::string testSampleFilename;
+    std::string testFilename;
+};
+
+// Prototype declaration
+void exitWithUsage();
+ParameterABExport parseCommandline(int argc, char* argv[]);
+bool isIdentifier(const std::string& name);
+std::string includeName(const std::string& headerFilename);
+void writeTestFile(const AdaBoost& adaBoost, const ParameterABExport& parameters);
+
+void exitWithUsage() {
+    std::cerr << "usage: abexport [options] model_file [header_file]" << std::endl;
+    std::cerr << "   (header_file: model_file.h by default)" << std::endl;
+    std::cerr << "options:" << std::endl;
+    std::cerr << "   -n: namespace of the predictor [default:adaboost_model]" << std::endl;
+    std::cerr << "   -g: group the stumps by feature (one threshold count per used feature)" << std::endl;
+    std::cerr << "   -t: sample file of a test program comparing the header with the scores of the model" << std::endl;
+    std::cerr << "       (written to header_file with \"_test.cpp\" in place of its extension)" << std::endl;
+    std::cerr << "   -v: verbose" << std::endl;
+    
+    exit(1);
+}
+
+ParameterABExport parseCommandline(int argc, char* argv[]) {
+    ParameterABExport parameters;
+    parameters.verbose = false;
+    parameters.groupByFeature = false;
+    parameters.name = "adaboost_model";
+    parameters.testSampleFilename = "";
+    parameters.testFilename = "";
+    
+    // Options
+    int argIndex;
+    for (argIndex = 1; argIndex < argc; ++argIndex) {
+        if (argv[argIndex][0] != '-') break;
+        
+        switch (argv[argIndex][1]) {
+            case 'v':
+                parameters.verbose = true;
+                break;
+            case 'g':
+                parameters.groupByFeature = true;
+                break;
+            case 'n':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                parameters.name = argv[argIndex];
+                if (!isIdentifier(parameters.name)) {
+                    std::cerr << "error: the name has to be a C++ identifier" << std::endl;
+                    exitWithUsage();
+                }
+                break;
+            }
+            case 't':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                parameters.testSampleFilename = argv[argIndex];
+                break;
+            }
+            default:
+                std::cerr << "error: undefined option" << std::endl;
+                exitWithUsage();
+                break;
+        }
+    }
+    
+    // Model file
+    if (argIndex >= argc) exitWithUsage();
+    parameters.modelFilename = argv[argIndex];
+    
+    // Header file
+    ++argIndex;
+    if (argIndex < argc) parameters.headerFilename = argv[argIndex];
+    else parameters.headerFilename = parameters.modelFilename + ".h";
+    
+    if (parameters.testSampleFilename != "") {
+        std::string::size_type slashPosition = parameters.headerFilename.rfind('/');
+        std::string::size_type dotPosition = parameters.headerFilename.rfind('.');
+        if (dotPosition == std::string::npos || (slashPosition != std::string::npos && dotPosition < slashPosition)) {
+            dotPosition = parameters.headerFilename.size();
+        }
+        parameters.testFilename = parameters.headerFilename.substr(0, dotPosition) + "_test.cpp";
+    }
+    
+    return parameters;
+}
+
+bool isIdentifier(const std::string& name) {
+    if (name.empty() || isdigit(static_cast<unsigned char>(name[0]))) return false;
+    for (size_t charIndex = 0; charIndex < name.size(); ++charIndex) {
+        if (!isalnum(static_cast<unsigned char>(name[charIndex])) && name[charIndex] != '_') return false;
+    }
+    return true;
+}
+
+std::string includeName(const std::string& headerFilename) {
+    std::string::size_type slashPosition = headerFilename.rfind('/');
+    if (slashPosition == std::string::npos) return headerFilename;
+    return headerFilename.substr(slashPosition + 1);
+}
+
+// The test program embeds the samples and their scores by AdaBoost::predict, and exits with 1
+// if a score of the exported predict differs by more than rounding
+void writeTestFile(const AdaBoost& adaBoost, const ParameterABExport& parameters) {
+    SparseSampleData samples;
+    std::vector<bool> sampleLabels;
+    readSampleDataFile(parameters.testSampleFilename, samples, sampleLabels);
+    int sampleTotal = static_cast<int>(samples.sampleOffsets.size()) - 1;
+    
+    // Features which aren't used by the model are dropped, as in abpredict
+    int featureDimension = adaBoost.featureDimension();
+    std::vector<long long> sampleOffsets(1, 0);
+    std::vector<int> featureIndices;
+    std::vector<double> featureValues;
+    std::vector<double> expectedScores(sampleTotal);
+    std::vector<double> featureVector(featureDimension);
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        std::fill(featureVector.begin(), featureVector.end(), 0.0);
+        for (long long elementIndex = samples.sampleOffsets[sampleIndex];
+             elementIndex < samples.sampleOffsets[sampleIndex + 1]; ++elementIndex)
+        {
+            int featureIndex = samples.featureIndices[elementIndex];
+            if (featureIndex >= featureDimension) continue;
+            featureVector[featureIndex] = samples.featureValues[elementIndex];
+            featureIndices.push_back(featureIndex);
+            featureValues.push_back(samples.featureValues[elementIndex]);
+        }
+        sampleOffsets.push_back(static_cast<long long>(featureIndices.size()));
+        expectedScores[sampleIndex] = adaBoost.predict(featureVector);
+    }
+    
+    std::ofstream outputStream(parameters.testFilename.c_str(), std::ios_base::out);
+    if (outputStream.fail()) {
+        std::cerr << "error: can't open file (" << parameters.testFilename << ")" << std::endl;
+        exit(1);
+    }
+    outputStream << std::setprecision(17);
+    
+    const std::string& name = parameters.name;
+    outputStream << "// Test generated by abexport: compares " << name << "::predict with AdaBoost::predict" << std::endl;
+    outputStream << "// on the samples of " << parameters.testSampleFilename << std::endl;
+    outputStream << std::endl;
+    outputStream << "#include <cstdio>" << std::endl;
+    outputStream << "#include <cmath>" << std::endl;
+    outputStream << "#include <vector>" << std::endl;
+    outputStream << "#include \"" << includeName(parameters.headerFilename) << "\"" << std::endl;
+    outputStream << std::endl;
+    outputStream << "// Nonzero features of sample i are [sampleOffsets[i], sampleOffsets[i+1])" << std::endl;
+    outputStream << "static const int sampleTotal = " << sampleTotal << ";" << std::endl;
+    const char* arrayNames[] = { "static const long long sampleOffsets[] = {", "static const int sampleFeatureIndices[] = {",
+                                 "static const double sampleFeatureValues[] = {", "static const double expectedScores[] = {" };
+    for (int arrayIndex = 0; arrayIndex < 4; ++arrayIndex) {
+        size_t valueTotal = arrayIndex == 0 ? sampleOffsets.size() : (arrayIndex == 3 ? expectedScores.size() : featureIndices.size());
+        int valuesPerLine = arrayIndex <= 1 ? 16 : 4;
+        outputStream << arrayNames[arrayIndex];
+        if (valueTotal == 0) outputStream << " 0";
+        for (size_t valueIndex = 0; valueIndex < valueTotal; ++valueIndex) {
+            if (valueIndex%valuesPerLine == 0) outputStream << std::endl << "   ";
+            outputStream << " ";
+            if (arrayIndex == 0) outputStream << sampleOffsets[valueIndex];
+            else if (arrayIndex == 1) outputStream << featureIndices[valueIndex];
+            else if (arrayIndex == 2) outputStream << featureValues[valueIndex];
+            else outputStream << expectedScores[valueIndex];
+            if (valueIndex + 1 < valueTotal) outputStream << ",";
+        }
+        outputStream << std::endl << "};" << std::endl;
+    }
+    
+    // Both sums add the same terms in a different order, so the tolerance scales with their magnitude
+    outputStream << std::endl;
+    outputStream << "int main() {" << std::endl;
+    outputStream << "    double outputScale = 0.0;" << std::endl;
+    if (parameters.groupByFeature) {
+        outputStream << "    for (int k = 0; k < " << name << "::groupThresholdOffsets[" << name << "::groupTotal] + "
+                     << name << "::groupTotal; ++k) {" << std::endl;
+        outputStream << "        outputScale += std::fabs(" << name << "::groupScores[k]);" << std::endl;
+    } else {
+        outputStream << "    for (int k = 0; k < 2*" << name << "::roundTotal; ++k) {" << std::endl;
+        outputStream << "        outputScale += std::fabs(" << name << "::stumpOutputs[k]);" << std::endl;
+    }
+    outputStream << "    }" << std::endl;
+    outputStream << "    double tolerance = 1e-12*(1.0 + outputScale);" << std::endl;
+    outputStream << std::endl;
+    outputStream << "    std::vector<double> features(" << name << "::featureDimension + 1, 0.0);" << std::endl;
+    outputStream << "    int failureTotal = 0;" << std::endl;
+    outputStream << "    for (int i = 0; i < sampleTotal; ++i) {" << std::endl;
+    outputStream << "        for (long long e = sampleOffsets[i]; e < sampleOffsets[i + 1]; ++e) "
+                 << "features[sampleFeatureIndices[e]] = sampleFeatureValues[e];" << std::endl;
+    outputStream << "        double score = " << name << "::predict(features.data());" << std::endl;
+    outputStream << "        if (std::fabs(score - expectedScores[i]) > tolerance) {" << std::endl;
+    outputStream << "            if (failureTotal < 10) std::printf(\"sample %d: %.17g (expected %.17g)\\n\", i + 1, score, expectedScores[i]);" << std::endl;
+    outputStream << "            ++failureTotal;" << std::endl;
+    outputStream << "        }" << std::endl;
+    outputStream << "        for (long long e = sampleOffsets[i]; e < sampleOffsets[i + 1]; ++e) features[sampleFeatureIndices[e]] = 0.0;" << std::endl;
+    outputStream << "    }" << std::endl;
+    outputStream << "    std::printf(\"%d / %d samples differ\\n\", failureTotal, sampleTotal);" << std::endl;
+    outputStream << std::endl;
+    outputStream << "    return failureTotal == 0 ? 0 : 1;" << std::endl;
+    outputStream << "}" << std::endl;
+    
+    outputStream.close();
+    if (outputStream.fail()) {
+        std::cerr << "error: can't write file (" << parameters.testFilename << ")" << std::endl;
+        exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ParameterABExport parameters = parseCommandline(argc, argv);
+    
+    if (parameters.verbose) {
+        std::cerr << std::endl;
+        std::cerr << "Model:  " << parameters.modelFilename << std::endl;
+        std::cerr << "Header: " << parameters.headerFilename << " (namespace " << parameters.name << ")" << std::endl;
+        if (parameters.groupByFeature) std::cerr << "   Grouped by feature" << std::endl;
+        if (parameters.testFilename != "") {
+            std::cerr << "Test:   " << parameters.testFilename << " (samples of " << parameters.testSampleFilename << ")" << std::endl;
+        }
+        std::cerr << std::endl;
+    }
+    
+    AdaBoost adaBoost;
+    adaBoost.readFile(parameters.modelFilename);
+    
+    adaBoost.writePredictorHeader(parameters.headerFilename, parameters.name, parameters.groupByFeature);
+    if (parameters.testFilename != "") writeTestFile(adaBoost, parameters);
+}
@@ -26,27 +26,84 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <iostream>
-#include <fstream>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "readSampleDataFile.h"
 #include "AdaBoost.h"
+#include "Profiler.h"
+
+// Samples are expanded and scored in blocks of this size
+const int predictionBlockSize = 4096;
+// Size of the blocks of the test file passed through the pipeline
+const long long streamBlockSize = 1 << 22;
 
 struct ParameterABPredict {
     bool verbose;
+    int threadTotal;
+    bool cascade;
     std::string testDataFilename;
     std::string modelFilename;
     bool outputScoreFile;
     std::string outputScorelFilename;
+    std::string profileFilename;
+};
+
+// Accuracy counters, accumulated by each scoring worker and summed at the end
+struct PredictionCounts {
+    long long positiveTotal;
+    long long positiveCorrectTotal;
+    long long negativeTotal;
+    long long negativeCorrectTotal;
+    long long evaluatedStumpTotal;
+    // Time spent by the worker in each phase (measured only with profiling)
+    double parseSeconds;
+    double scoreSeconds;
+};
+
+// Block of the test file on its way through the pipeline (read -> scored -> written)
+struct PredictionSlot {
+    enum State { Empty, Read, Scored };
+    
+    State state;
+    SampleDataBlock input;
+    std::string scoreText;
+};
+
+// Reader, scoring workers and writer share a ring of slots.
+// Block k always goes to slot k % slotTotal, so the writer can reassemble the scores in input order.
+struct PredictionPipeline {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<PredictionSlot> slots;
+    std::deque<int> readSlotIndices;
+    bool readFinished;
+    long long blockTotal;
 };
 
 // Prototype declaration
 void exitWithUsage();
 ParameterABPredict parseCommandline(int argc, char* argv[]);
+long long scoreSamples(const AdaBoost& adaBoost, const SparseSampleData& samples, const bool cascade,
+                       std::vector<double>& scores);
+void readTestBlocks(SampleDataStream& testStream, PredictionPipeline& pipeline);
+void scoreTestBlocks(const AdaBoost& adaBoost, const ParameterABPredict& parameters,
+                     PredictionPipeline& pipeline, PredictionCounts& counts);
+void writeScoreBlocks(FILE* outputScoreFile, const ParameterABPredict& parameters, PredictionPipeline& pipeline);
 
 void exitWithUsage() {
-    std::cerr << "usage: abtrain [options] test_set_file model_file" << std::endl;
+    std::cerr << "usage: abpredict [options] test_set_file model_file" << std::endl;
+    std::cerr << "   (test_set_file \"-\": standard input)" << std::endl;
     std::cerr << "options:" << std::endl;
-    std::cerr << "   -o: output score file" << std::endl;
+    std::cerr << "   -o: output score file (\"-\": standard output)" << std::endl;
+    std::cerr << "   -j: the number of scoring threads [default:1]" << std::endl;
+    std::cerr << "   -c: cascade prediction (stops at the rejection thresholds of the model)" << std::endl;
+    std::cerr << "   --profile: output file of phase timings (JSON lines)" << std::endl;
     std::cerr << "   -v: verbose" << std::endl;
     
     exit(1);
@@ -55,18 +112,31 @@ void exitWithUsage() {
 ParameterABPredict parseCommandline(int argc, char* argv[]) {
     ParameterABPredict parameters;
     parameters.verbose = false;
+    parameters.threadTotal = 1;
+    parameters.cascade = false;
     parameters.outputScoreFile = false;
     parameters.outputScorelFilename = "";
+    parameters.profileFilename = "";
     
     // Options
     int argIndex;
     for (argIndex = 1; argIndex < argc; ++argIndex) {
-        if (argv[argIndex][0] != '-') break;
+        if (argv[argIndex][0] != '-' || argv[argIndex][1] == '\0') break;
+        
+        if (strcmp(argv[argIndex], "--profile") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.profileFilename = argv[argIndex];
+            continue;
+        }
         
         switch (argv[argIndex][1]) {
             case 'v':
                 parameters.verbose = true;
                 break;
+            case 'c':
+                parameters.cascade = true;
+                break;
             case 'o':
             {
                 ++argIndex;
@@ -75,6 +145,18 @@ ParameterABPredict parseCommandline(int argc, char* argv[]) {
                 parameters.outputScorelFilename = argv[argIndex];
                 break;
             }
+            case 'j':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int threadTotal = atoi(argv[argIndex]);
+                if (threadTotal < 1) {
+                    std::cerr << "error: invalid number of threads" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.threadTotal = threadTotal;
+                break;
+            }
             default:
                 std::cerr << "error: undefined option" << std::endl;
                 exitWithUsage();
@@ -94,6 +176,149 @@ ParameterABPredict parseCommandline(int argc, char* argv[]) {
     return parameters;
 }
 
+long long scoreSamples(const AdaBoost& adaBoost, const SparseSampleData& samples, const bool cascade,
+                       std::vector<double>& scores)
+{
+    int sampleTotal = static_cast<int>(samples.sampleOffsets.size()) - 1;
+    scores.resize(sampleTotal);
+    
+    // Samples are expanded into a row-major block of the features used by the model only, so that its size
+    // doesn't depend on the largest feature index of a sparse model
+    int usedFeatureTotal = adaBoost.usedFeatureTotal();
+    std::vector<double> blockSamples(static_cast<size_t>(predictionBlockSize)*usedFeatureTotal);
+    long long evaluatedStumpTotal = 0;
+    for (int blockBegin = 0; blockBegin < sampleTotal; blockBegin += predictionBlockSize) {
+        int blockSampleTotal = std::min(predictionBlockSize, sampleTotal - blockBegin);
+        std::fill(blockSamples.begin(), blockSamples.end(), 0.0);
+        for (int i = 0; i < blockSampleTotal; ++i) {
+            double* featureVector = &blockSamples[static_cast<size_t>(i)*usedFeatureTotal];
+            for (long long elementIndex = samples.sampleOffsets[blockBegin + i];
+                 elementIndex < samples.sampleOffsets[blockBegin + i + 1]; ++elementIndex)
+            {
+                int usedIndex = adaBoost.usedFeatureColumn(samples.featureIndices[elementIndex]);
+                if (usedIndex >= 0) featureVector[usedIndex] = samples.featureValues[elementIndex];
+            }
+        }
+        if (cascade) {
+            evaluatedStumpTotal += adaBoost.predictCascade(blockSamples.data(), blockSampleTotal, usedFeatureTotal,
+                                                           AdaBoost::RowMajor, &scores[blockBegin], AdaBoost::UsedFeatures);
+        } else {
+            adaBoost.predictBatch(blockSamples.data(), blockSampleTotal, usedFeatureTotal, AdaBoost::RowMajor,
+                                  &scores[blockBegin], AdaBoost::UsedFeatures);
+        }
+    }
+    
+    return evaluatedStumpTotal;
+}
+
+void readTestBlocks(SampleDataStream& testStream, PredictionPipeline& pipeline) {
+    int slotTotal = static_cast<int>(pipeline.slots.size());
+    for (long long blockIndex = 0; ; ++blockIndex) {
+        int slotIndex = static_cast<int>(blockIndex%slotTotal);
+        PredictionSlot& slot = pipeline.slots[slotIndex];
+        {
+            std::unique_lock<std::mutex> lock(pipeline.mutex);
+            pipeline.condition.wait(lock, [&slot] { return slot.state == PredictionSlot::Empty; });
+        }
+        
+        // An empty slot belongs to the reader until it is queued
+        bool blockRead = testStream.readBlock(slot.input);
+        {
+            std::lock_guard<std::mutex> lock(pipeline.mutex);
+            if (blockRead) {
+                slot.state = PredictionSlot::Read;
+                pipeline.readSlotIndices.push_back(slotIndex);
+            } else {
+                pipeline.readFinished = true;
+                pipeline.blockTotal = blockIndex;
+            }
+        }
+        pipeline.condition.notify_all();
+        if (!blockRead) break;
+    }
+}
+
+void scoreTestBlocks(const AdaBoost& adaBoost, const ParameterABPredict& parameters,
+                     PredictionPipeline& pipeline, PredictionCounts& counts)
+{
+    SparseSampleData testSamples;
+    std::vector<bool> testLabels;
+    std::vector<double> testScores;
+    while (true) {
+        int slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(pipeline.mutex);
+            pipeline.condition.wait(lock, [&pipeline] { return !pipeline.readSlotIndices.empty() || pipeline.readFinished; });
+            if (pipeline.readSlotIndices.empty()) break;
+            slotIndex = pipeline.readSlotIndices.front();
+            pipeline.readSlotIndices.pop_front();
+        }
+        PredictionSlot& slot = pipeline.slots[slotIndex];
+        
+        bool profiling = Profiler::enabled();
+        double parseBeginTime = profiling ? Profiler::now() : 0.0;
+        parseSampleDataBlock(slot.input, parameters.testDataFilename, testSamples, testLabels);
+        double scoreBeginTime = profiling ? Profiler::now() : 0.0;
+        counts.evaluatedStumpTotal += scoreSamples(adaBoost, testSamples, parameters.cascade, testScores);
+        if (profiling) {
+            counts.parseSeconds += scoreBeginTime - parseBeginTime;
+            counts.scoreSeconds += Profiler::now() - scoreBeginTime;
+        }
+        
+        slot.scoreText.clear();
+        for (int sampleIndex = 0; sampleIndex < static_cast<int>(testLabels.size()); ++sampleIndex) {
+            double score = testScores[sampleIndex];
+            
+            if (testLabels[sampleIndex]) {
+                ++counts.positiveTotal;
+                if (score > 0) ++counts.positiveCorrectTotal;
+            } else {
+                ++counts.negativeTotal;
+                if (score <= 0) ++counts.negativeCorrectTotal;
+            }
+            
+            if (parameters.outputScoreFile) {
+                char scoreString[32];
+                int scoreLength = snprintf(scoreString, sizeof(scoreString), "%g\n", score);
+                slot.scoreText.append(scoreString, scoreLength);
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(pipeline.mutex);
+            slot.state = PredictionSlot::Scored;
+        }
+        pipeline.condition.notify_all();
+    }
+}
+
+void writeScoreBlocks(FILE* outputScoreFile, const ParameterABPredict& parameters, PredictionPipeline& pipeline) {
+    int slotTotal = static_cast<int>(pipeline.slots.size());
+    for (long long blockIndex = 0; ; ++blockIndex) {
+        PredictionSlot& slot = pipeline.slots[blockIndex%slotTotal];
+        {
+            std::unique_lock<std::mutex> lock(pipeline.mutex);
+            pipeline.condition.wait(lock, [&] {
+                return slot.state == PredictionSlot::Scored || (pipeline.readFinished && blockIndex >= pipeline.blockTotal);
+            });
+            if (slot.state != PredictionSlot::Scored) break;
+        }
+        
+        if (outputScoreFile != NULL
+            && fwrite(slot.scoreText.data(), 1, slot.scoreText.size(), outputScoreFile) != slot.scoreText.size())
+        {
+            std::cerr << "error: can't write file (" << parameters.outputScorelFilename << ")" << std::endl;
+            exit(1);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(pipeline.mutex);
+            slot.state = PredictionSlot::Empty;
+        }
+        pipeline.condition.notify_all();
+    }
+}
+
 int main(int argc, char* argv[]) {
     ParameterABPredict parameters = parseCommandline(argc, argv);
     
@@ -104,55 +329,103 @@ int main(int argc, char* argv[]) {
         if (parameters.outputScoreFile) {
             std::cerr << "Output score: " << parameters.outputScorelFilename << std::endl;
         }
+        std::cerr << "#threads:  " << parameters.threadTotal << std::endl;
+        if (parameters.cascade) std::cerr << "Cascade prediction" << std::endl;
         std::cerr << std::endl;
     }
 
+    if (!parameters.profileFilename.empty() && !Profiler::open(parameters.profileFilename)) {
+        std::cerr << "error: can't open file (" << parameters.profileFilename << ")" << std::endl;
+        exit(1);
+    }
+    
     AdaBoost adaBoost;
-    adaBoost.readFile(parameters.modelFilename);
+    {
+        ScopedPhaseTimer timer("read_model");
+        adaBoost.readFile(parameters.modelFilename);
+    }
     
-    std::vector< std::vector<double> > testSamples;
-    std::vector<bool> testLabels;
-    readSampleDataFile(parameters.testDataFilename, testSamples, testLabels);
-    int testSampleTotal = static_cast<int>(testSamples.size());
-
-    std::ofstream outputScoreStream;
+    SampleDataStream testStream(parameters.testDataFilename, streamBlockSize);
+    
+    FILE* outputScoreFile = NULL;
     if (parameters.outputScoreFile) {
-        outputScoreStream.open(parameters.outputScorelFilename.c_str(), std::ios_base::out);
-        if (outputScoreStream.fail()) {
+        if (parameters.outputScorelFilename == "-") outputScoreFile = stdout;
+        else outputScoreFile = fopen(parameters.outputScorelFilename.c_str(), "w");
+        if (outputScoreFile == NULL) {
             std::cerr << "error: can't open file (" << parameters.outputScorelFilename << ")" << std::endl;
             exit(1);
         }
     }
-
-    int positiveTotal = 0;
-    int positiveCorrectTotal = 0;
-    int negativeTotal = 0;
-    int negativeCorrectTotal = 0;
-    for (int sampleIndex = 0; sampleIndex < testSampleTotal; ++sampleIndex) {
-        double score = adaBoost.predict(testSamples[sampleIndex]);
-        
-        if (testLabels[sampleIndex]) {
-            ++positiveTotal;
-            if (score > 0) ++positiveCorrectTotal;
-        } else {
-            ++negativeTotal;
-            if (score <= 0) ++negativeCorrectTotal;
-        }
+    
+    // Pipeline: the reader thread reads blocks of the test file, scoring workers parse and score them,
+    // and this thread writes the scores in input order
+    PredictionPipeline pipeline;
+    pipeline.slots.resize(2*parameters.threadTotal);
+    for (int slotIndex = 0; slotIndex < static_cast<int>(pipeline.slots.size()); ++slotIndex) {
+        pipeline.slots[slotIndex].state = PredictionSlot::Empty;
+    }
+    pipeline.readFinished = false;
+    pipeline.blockTotal = 0;
+    
+    PredictionCounts zeroCounts = { 0, 0, 0, 0, 0, 0.0, 0.0 };
+    std::vector<PredictionCounts> workerCounts(parameters.threadTotal, zeroCounts);
+    std::vector<std::thread> workers;
+    for (int threadIndex = 0; threadIndex < parameters.threadTotal; ++threadIndex) {
+        workers.push_back(std::thread(scoreTestBlocks, std::cref(adaBoost), std::cref(parameters),
+                                      std::ref(pipeline), std::ref(workerCounts[threadIndex])));
+    }
+    std::thread reader(readTestBlocks, std::ref(testStream), std::ref(pipeline));
+    
+    {
+        ScopedPhaseTimer timer("predict");
+        writeScoreBlocks(outputScoreFile, parameters, pipeline);
         
-        if (parameters.outputScoreFile) {
-            outputScoreStream << score << std::endl;
-        }
+        reader.join();
+        for (int threadIndex = 0; threadIndex < parameters.threadTotal; ++threadIndex) workers[threadIndex].join();
+    }
+    
+    long long positiveTotal = 0;
+    long long positiveCorrectTotal = 0;
+    long long negativeTotal = 0;
+    long long negativeCorrectTotal = 0;
+    long long evaluatedStumpTotal = 0;
+    double parseSeconds = 0.0;
+    double scoreSeconds = 0.0;
+    for (int threadIndex = 0; threadIndex < parameters.threadTotal; ++threadIndex) {
+        positiveTotal += workerCounts[threadIndex].positiveTotal;
+        positiveCorrectTotal += workerCounts[threadIndex].positiveCorrectTotal;
+        negativeTotal += workerCounts[threadIndex].negativeTotal;
+        negativeCorrectTotal += workerCounts[threadIndex].negativeCorrectTotal;
+        evaluatedStumpTotal += workerCounts[threadIndex].evaluatedStumpTotal;
+        parseSeconds += workerCounts[threadIndex].parseSeconds;
+        scoreSeconds += workerCounts[threadIndex].scoreSeconds;
+    }
+    if (Profiler::enabled()) {
+        // Seconds summed over the scoring threads, which parse and score blocks concurrently
+        ProfileRecord record("prediction");
+        record.addNumber("parse_seconds", parseSeconds);
+        record.addNumber("score_seconds", scoreSeconds);
+        record.addInteger("samples", positiveTotal + negativeTotal);
+        if (parameters.cascade) record.addInteger("stumps_evaluated", evaluatedStumpTotal);
+        Profiler::write(record);
+        Profiler::close();
     }
     if (parameters.outputScoreFile) {
-        outputScoreStream.close();
+        if (outputScoreFile == stdout) fflush(outputScoreFile);
+        else fclose(outputScoreFile);
     }
-
-
+    
+    // The summary goes to the standard error if the scores are written to the standard output
+    std::ostream& summaryStream = (outputScoreFile == stdout) ? std::cerr : std::cout;
     double accuracyAll = static_cast<double>(positiveCorrectTotal + negativeCorrectTotal)/(positiveTotal + negativeTotal);
-    std::cout << "Accuracy = " << accuracyAll;
-    std::cout << " (" << positiveCorrectTotal + negativeCorrectTotal << " / " << positiveTotal + negativeTotal << ")" << std::endl;
-    std::cout << "  positive: " << static_cast<double>(positiveCorrectTotal)/positiveTotal;
-    std::cout << " (" << positiveCorrectTotal << " / " << positiveTotal << "), ";
-    std::cout << "negative: " << static_cast<double>(negativeCorrectTotal)/negativeTotal;
-    std::cout << " (" << negativeCorrectTotal << " / " << negativeTotal << ")" << std::endl;
+    summaryStream << "Accuracy = " << accuracyAll;
+    summaryStream << " (" << positiveCorrectTotal + negativeCorrectTotal << " / " << positiveTotal + negativeTotal << ")" << std::endl;
+    summaryStream << "  positive: " << static_cast<double>(positiveCorrectTotal)/positiveTotal;
+    summaryStream << " (" << positiveCorrectTotal << " / " << positiveTotal << "), ";
+    summaryStream << "negative: " << static_cast<double>(negativeCorrectTotal)/negativeTotal;
+    summaryStream << " (" << negativeCorrectTotal << " / " << negativeTotal << ")" << std::endl;
+    if (parameters.verbose && parameters.cascade) {
+        summaryStream << "Stumps per sample = " << static_cast<double>(evaluatedStumpTotal)/(positiveTotal + negativeTotal);
+        summaryStream << std::endl;
+    }
 }
@@ -27,8 +27,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <iostream>
 #include <string>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 #include "AdaBoost.h"
+#include "Profiler.h"
 
 struct ParameterABTrain {
     bool verbose;
@@ -36,6 +40,27 @@ struct ParameterABTrain {
     std::string outputModelFilename;
     int boostingType;
     int roundTotal;
+    int threadTotal;
+    int binTotal;
+    bool sparseTraining;
+    bool compactStorage;
+    long long memoryBudget;
+    double trimmingWeightRate;
+    double featureSamplingRate;
+    int keptFeatureTotal;
+    double gradientTopRate;
+    double gradientOtherRate;
+    unsigned int seed;
+    bool pruning;
+    double detectionRate;
+    std::string initialModelFilename;
+    int checkpointInterval;
+    std::string validationDataFilename;
+    int earlyStoppingRoundTotal;
+    std::string progressFilename;
+    std::string profileFilename;
+    bool sharded;
+    std::vector<std::string> shardFilenames;
 };
 
 // Prototype declaration
@@ -47,6 +72,26 @@ void exitWithUsage() {
     std::cerr << "options:" << std::endl;
     std::cerr << "   -t: type of boosting (0:discrete, 1:real, 2:gentle) [default:2]" << std::endl;
     std::cerr << "   -r: the number of rounds [default:100]" << std::endl;
+    std::cerr << "   -j: the number of threads [default:1]" << std::endl;
+    std::cerr << "   -b: the number of bins per feature (2-256, 0:exact) [default:0]" << std::endl;
+    std::cerr << "   -s: sparse training (only nonzero values are stored)" << std::endl;
+    std::cerr << "   -f: compact storage (float values, 16-bit sample indices up to 65536 samples)" << std::endl;
+    std::cerr << "   --memory-budget: out-of-core training of a binary sample file within this many MB (0:off) [default:0]" << std::endl;
+    std::cerr << "   -w: weight trimming, fraction of the total weight kept (0-1, 0:no trimming) [default:0]" << std::endl;
+    std::cerr << "   -p: fraction of the features evaluated per round (0-1, 0:all) [default:0]" << std::endl;
+    std::cerr << "   -k: the number of best features of the previous round added to the sampled features [default:0]" << std::endl;
+    std::cerr << "   -g: gradient-based sampling, top_rate,other_rate (fractions of samples, needs -b) [default:off]" << std::endl;
+    std::cerr << "   --seed: random seed of feature and sample sampling [default:0]" << std::endl;
+    std::cerr << "   -e: skip features by lower bounds of their errors (experimental, same model)" << std::endl;
+    std::cerr << "   -d: detection rate of the cascade thresholds (0-1, 0:no cascade) [default:0]" << std::endl;
+    std::cerr << "   -m: initial model file, whose training is continued (e.g. a checkpoint)" << std::endl;
+    std::cerr << "   -c: the number of rounds between checkpoints (model_file.checkpoint, 0:none) [default:0]" << std::endl;
+    std::cerr << "   --validation: validation set file, whose loss and accuracy are tracked every round" << std::endl;
+    std::cerr << "   --early-stopping: stop when the validation loss hasn't decreased for this number of rounds [default:0]" << std::endl;
+    std::cerr << "   --progress: output file of the loss and accuracy of every round" << std::endl;
+    std::cerr << "   --profile: output file of phase timings and per-round counters (JSON lines)" << std::endl;
+    std::cerr << "   --shards: training_set_file is a comma-separated list of shard files, each read by its own" << std::endl;
+    std::cerr << "             worker process (needs -b, only with -t, -r, -j, -c, --profile, -v)" << std::endl;
     std::cerr << "   -v: verbose" << std::endl;
     
     exit(1);
@@ -57,16 +102,96 @@ ParameterABTrain parseCommandline(int argc, char* argv[]) {
     parameters.verbose = false;
     parameters.boostingType = 2;
     parameters.roundTotal = 100;
+    parameters.threadTotal = 1;
+    parameters.binTotal = 0;
+    parameters.sparseTraining = false;
+    parameters.compactStorage = false;
+    parameters.memoryBudget = 0;
+    parameters.trimmingWeightRate = 0;
+    parameters.featureSamplingRate = 0;
+    parameters.keptFeatureTotal = 0;
+    parameters.gradientTopRate = 0;
+    parameters.gradientOtherRate = 0;
+    parameters.seed = 0;
+    parameters.pruning = false;
+    parameters.detectionRate = 0;
+    parameters.initialModelFilename = "";
+    parameters.checkpointInterval = 0;
+    parameters.validationDataFilename = "";
+    parameters.earlyStoppingRoundTotal = 0;
+    parameters.progressFilename = "";
+    parameters.profileFilename = "";
+    parameters.sharded = false;
     
     // Options
     int argIndex;
     for (argIndex = 1; argIndex < argc; ++argIndex) {
         if (argv[argIndex][0] != '-') break;
         
+        if (strcmp(argv[argIndex], "--seed") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.seed = static_cast<unsigned int>(strtoul(argv[argIndex], NULL, 10));
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--memory-budget") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            long long memoryBudget = atoll(argv[argIndex]);
+            if (memoryBudget < 0) {
+                std::cerr << "error: negative memory budget" << std::endl;
+                exitWithUsage();
+            }
+            parameters.memoryBudget = memoryBudget;
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--validation") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.validationDataFilename = argv[argIndex];
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--early-stopping") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            int earlyStoppingRoundTotal = atoi(argv[argIndex]);
+            if (earlyStoppingRoundTotal < 0) {
+                std::cerr << "error: negative number of rounds of early stopping" << std::endl;
+                exitWithUsage();
+            }
+            parameters.earlyStoppingRoundTotal = earlyStoppingRoundTotal;
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--progress") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.progressFilename = argv[argIndex];
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--profile") == 0) {
+            ++argIndex;
+            if (argIndex >= argc) exitWithUsage();
+            parameters.profileFilename = argv[argIndex];
+            continue;
+        }
+        if (strcmp(argv[argIndex], "--shards") == 0) {
+            parameters.sharded = true;
+            continue;
+        }
+        
         switch (argv[argIndex][1]) {
             case 'v':
                 parameters.verbose = true;
                 break;
+            case 's':
+                parameters.sparseTraining = true;
+                break;
+            case 'f':
+                parameters.compactStorage = true;
+                break;
+            case 'e':
+                parameters.pruning = true;
+                break;
             case 't':
             {
                 ++argIndex;
@@ -91,6 +216,112 @@ ParameterABTrain parseCommandline(int argc, char* argv[]) {
                 parameters.roundTotal = roundTotal;
                 break;
             }
+            case 'j':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int threadTotal = atoi(argv[argIndex]);
+                if (threadTotal < 1) {
+                    std::cerr << "error: invalid number of threads" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.threadTotal = threadTotal;
+                break;
+            }
+            case 'b':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int binTotal = atoi(argv[argIndex]);
+                if (binTotal < 0 || binTotal == 1 || binTotal > 256) {
+                    std::cerr << "error: invalid number of bins" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.binTotal = binTotal;
+                break;
+            }
+            case 'w':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                double trimmingWeightRate = atof(argv[argIndex]);
+                if (trimmingWeightRate < 0 || trimmingWeightRate > 1) {
+                    std::cerr << "error: invalid weight rate of trimming" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.trimmingWeightRate = trimmingWeightRate;
+                break;
+            }
+            case 'p':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                double featureSamplingRate = atof(argv[argIndex]);
+                if (featureSamplingRate < 0 || featureSamplingRate > 1) {
+                    std::cerr << "error: invalid fraction of features" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.featureSamplingRate = featureSamplingRate;
+                break;
+            }
+            case 'k':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int keptFeatureTotal = atoi(argv[argIndex]);
+                if (keptFeatureTotal < 0) {
+                    std::cerr << "error: negative number of features" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.keptFeatureTotal = keptFeatureTotal;
+                break;
+            }
+            case 'g':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                double topRate, otherRate;
+                if (sscanf(argv[argIndex], "%lf,%lf", &topRate, &otherRate) != 2
+                    || topRate <= 0 || otherRate <= 0 || topRate + otherRate > 1)
+                {
+                    std::cerr << "error: invalid rates of gradient-based sampling" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.gradientTopRate = topRate;
+                parameters.gradientOtherRate = otherRate;
+                break;
+            }
+            case 'd':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                double detectionRate = atof(argv[argIndex]);
+                if (detectionRate < 0 || detectionRate > 1) {
+                    std::cerr << "error: invalid detection rate" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.detectionRate = detectionRate;
+                break;
+            }
+            case 'm':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                parameters.initialModelFilename = argv[argIndex];
+                break;
+            }
+            case 'c':
+            {
+                ++argIndex;
+                if (argIndex >= argc) exitWithUsage();
+                int checkpointInterval = atoi(argv[argIndex]);
+                if (checkpointInterval < 0) {
+                    std::cerr << "error: negative number of rounds between checkpoints" << std::endl;
+                    exitWithUsage();
+                }
+                parameters.checkpointInterval = checkpointInterval;
+                break;
+            }
             default:
                 std::cerr << "error: undefined option" << std::endl;
                 exitWithUsage();
@@ -101,6 +332,34 @@ ParameterABTrain parseCommandline(int argc, char* argv[]) {
     // Training data file
     if (argIndex >= argc) exitWithUsage();
     parameters.trainingDataFilename = argv[argIndex];
+    if (parameters.sharded) {
+        std::string shardList = parameters.trainingDataFilename;
+        size_t nameBegin = 0;
+        while (true) {
+            size_t nameEnd = shardList.find(',', nameBegin);
+            if (nameEnd == std::string::npos) nameEnd = shardList.size();
+            if (nameEnd > nameBegin) parameters.shardFilenames.push_back(shardList.substr(nameBegin, nameEnd - nameBegin));
+            if (nameEnd == shardList.size()) break;
+            nameBegin = nameEnd + 1;
+        }
+        if (parameters.shardFilenames.empty()) exitWithUsage();
+        parameters.trainingDataFilename = parameters.shardFilenames[0];
+        
+        if (parameters.binTotal == 0) {
+            std::cerr << "error: sharded training needs binning (-b)" << std::endl;
+            exitWithUsage();
+        }
+        if (parameters.sparseTraining || parameters.compactStorage || parameters.memoryBudget > 0
+            || parameters.trimmingWeightRate > 0
+            || parameters.featureSamplingRate > 0 || parameters.gradientTopRate > 0 || parameters.pruning
+            || parameters.detectionRate > 0
+            || !parameters.validationDataFilename.empty() || parameters.earlyStoppingRoundTotal > 0
+            || !parameters.progressFilename.empty())
+        {
+            std::cerr << "error: option which can't be used with sharded training" << std::endl;
+            exitWithUsage();
+        }
+    }
     
     // Model file
     ++argIndex;
@@ -116,17 +375,89 @@ int main(int argc, char* argv[]) {
     if (parameters.verbose) {
         std::string boostingTypeName[3] = {"discrete", "real", "gentle"};
         std::cerr << std::endl;
-        std::cerr << "Traing data:  " << parameters.trainingDataFilename << std::endl;
+        if (parameters.sharded) {
+            std::cerr << "Shards:       " << parameters.shardFilenames.size() << " files" << std::endl;
+        } else {
+            std::cerr << "Traing data:  " << parameters.trainingDataFilename << std::endl;
+        }
         std::cerr << "Output model: " << parameters.outputModelFilename << std::endl;
         std::cerr << "   Type:      " << boostingTypeName[parameters.boostingType] << std::endl;
         std::cerr << "   #rounds:   " << parameters.roundTotal << std::endl;
+        std::cerr << "   #threads:  " << parameters.threadTotal << std::endl;
+        if (parameters.binTotal > 0) std::cerr << "   #bins:     " << parameters.binTotal << std::endl;
+        if (parameters.sparseTraining) std::cerr << "   Sparse training" << std::endl;
+        if (parameters.compactStorage) std::cerr << "   Compact storage" << std::endl;
+        if (parameters.memoryBudget > 0) std::cerr << "   Memory budget: " << parameters.memoryBudget << " MB" << std::endl;
+        if (parameters.trimmingWeightRate > 0) std::cerr << "   Weight trimming: " << parameters.trimmingWeightRate << std::endl;
+        if (parameters.featureSamplingRate > 0) {
+            std::cerr << "   Feature sampling: " << parameters.featureSamplingRate;
+            std::cerr << " (+" << parameters.keptFeatureTotal << " best)" << std::endl;
+        }
+        if (parameters.gradientTopRate > 0) {
+            std::cerr << "   Gradient-based sampling: " << parameters.gradientTopRate;
+            std::cerr << " + " << parameters.gradientOtherRate << std::endl;
+        }
+        if (parameters.featureSamplingRate > 0 || parameters.gradientTopRate > 0) {
+            std::cerr << "   Seed:      " << parameters.seed << std::endl;
+        }
+        if (parameters.pruning) std::cerr << "   Feature pruning" << std::endl;
+        if (parameters.detectionRate > 0) std::cerr << "   Cascade detection rate: " << parameters.detectionRate << std::endl;
+        if (!parameters.initialModelFilename.empty()) {
+            std::cerr << "   Initial model: " << parameters.initialModelFilename << std::endl;
+        }
+        if (!parameters.validationDataFilename.empty()) {
+            std::cerr << "   Validation data: " << parameters.validationDataFilename << std::endl;
+        }
+        if (parameters.earlyStoppingRoundTotal > 0) {
+            std::cerr << "   Early stopping: " << parameters.earlyStoppingRoundTotal << " rounds" << std::endl;
+        }
+        if (parameters.checkpointInterval > 0) {
+            std::cerr << "   Checkpoint: " << parameters.outputModelFilename << ".checkpoint";
+            std::cerr << " (every " << parameters.checkpointInterval << " rounds)" << std::endl;
+        }
         std::cerr << std::endl;
     }
     
+    if (!parameters.profileFilename.empty() && !Profiler::open(parameters.profileFilename)) {
+        std::cerr << "error: can't open file (" << parameters.profileFilename << ")" << std::endl;
+        exit(1);
+    }
+    
     AdaBoost adaBoost;
     adaBoost.setBoostingType(parameters.boostingType);
+    adaBoost.setThreadTotal(parameters.threadTotal);
+    adaBoost.setBinTotal(parameters.binTotal);
+    adaBoost.setSparseTraining(parameters.sparseTraining);
+    adaBoost.setCompactStorage(parameters.compactStorage);
+    adaBoost.setMemoryBudget(parameters.memoryBudget);
+    adaBoost.setWeightTrimming(parameters.trimmingWeightRate);
+    adaBoost.setFeatureSampling(parameters.featureSamplingRate, parameters.keptFeatureTotal);
+    adaBoost.setGradientSampling(parameters.gradientTopRate, parameters.gradientOtherRate);
+    adaBoost.setRandomSeed(parameters.seed);
+    adaBoost.setPruning(parameters.pruning);
+    if (parameters.sharded) {
+        adaBoost.setCheckpoint(parameters.outputModelFilename + ".checkpoint", parameters.checkpointInterval);
+        adaBoost.trainSharded(parameters.shardFilenames, parameters.roundTotal, parameters.initialModelFilename,
+                              parameters.verbose);
+        {
+            ScopedPhaseTimer timer("write_model");
+            adaBoost.writeFile(parameters.outputModelFilename);
+        }
+        Profiler::close();
+        return 0;
+    }
     adaBoost.setTrainingSamples(parameters.trainingDataFilename);
+    if (!parameters.initialModelFilename.empty()) adaBoost.setInitialModel(parameters.initialModelFilename);
+    if (!parameters.validationDataFilename.empty()) adaBoost.setValidationSamples(parameters.validationDataFilename);
+    adaBoost.setEarlyStopping(parameters.earlyStoppingRoundTotal);
+    adaBoost.setProgressFile(parameters.progressFilename);
+    adaBoost.setCheckpoint(parameters.outputModelFilename + ".checkpoint", parameters.checkpointInterval);
     adaBoost.train(parameters.roundTotal, parameters.verbose);
+    if (parameters.detectionRate > 0) adaBoost.calibrateCascade(parameters.detectionRate, parameters.verbose);
     
-    adaBoost.writeFile(parameters.outputModelFilename);
+    {
+        ScopedPhaseTimer timer("write_model");
+        adaBoost.writeFile(parameters.outputModelFilename);
+    }
+    Profiler::close();
 }
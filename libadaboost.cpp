@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "libadaboost.h"
+#include <new>
+#include <exception>
+#include "AdaBoost.h"
+
+struct adaboost_model {
+    AdaBoost adaBoost;
+    int featureDimension;
+};
+
+template <typename T>
+static int predictDense(const adaboost_model* model, const T* samples, const int sampleTotal,
+                        const int featureTotal, const long long stride, double* scores)
+{
+    if (model == NULL || sampleTotal < 0 || featureTotal < 0 || stride < featureTotal) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    if (sampleTotal > 0 && ((samples == NULL && featureTotal > 0) || scores == NULL)) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    
+    // Features beyond those of the model are never read
+    int readFeatureTotal = featureTotal < model->featureDimension ? featureTotal : model->featureDimension;
+    for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        scores[sampleIndex] = model->adaBoost.predict(samples + sampleIndex*stride, readFeatureTotal);
+    }
+    
+    return ADABOOST_OK;
+}
+
+int adaboost_api_version(void) {
+    return ADABOOST_API_VERSION;
+}
+
+const char* adaboost_status_message(int status) {
+    switch (status) {
+        case ADABOOST_OK:
+            return "success";
+        case ADABOOST_ERROR_INVALID_ARGUMENT:
+            return "invalid argument";
+        case ADABOOST_ERROR_CANT_OPEN_FILE:
+            return "can't open file";
+        case ADABOOST_ERROR_BAD_FORMAT:
+            return "bad format in model file";
+        case ADABOOST_ERROR_OUT_OF_MEMORY:
+            return "out of memory";
+        default:
+            return "unknown status";
+    }
+}
+
+int adaboost_model_load(const char* filename, adaboost_model** model) {
+    if (model == NULL) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    *model = NULL;
+    if (filename == NULL) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    
+    // No exception may cross the C boundary
+    try {
+        adaboost_model* loadedModel = new adaboost_model();
+        AdaBoost::ModelFileStatus status = loadedModel->adaBoost.loadFile(filename);
+        if (status != AdaBoost::ModelFileRead) {
+            delete loadedModel;
+            return status == AdaBoost::ModelFileCantOpen ? ADABOOST_ERROR_CANT_OPEN_FILE : ADABOOST_ERROR_BAD_FORMAT;
+        }
+        loadedModel->featureDimension = loadedModel->adaBoost.featureDimension();
+        *model = loadedModel;
+    } catch (const std::bad_alloc&) {
+        return ADABOOST_ERROR_OUT_OF_MEMORY;
+    } catch (const std::exception&) {
+        return ADABOOST_ERROR_BAD_FORMAT;
+    }
+    
+    return ADABOOST_OK;
+}
+
+void adaboost_model_free(adaboost_model* model) {
+    delete model;
+}
+
+int adaboost_model_feature_dimension(const adaboost_model* model, int* featureDimension) {
+    if (model == NULL || featureDimension == NULL) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    
+    *featureDimension = model->featureDimension;
+    return ADABOOST_OK;
+}
+
+int adaboost_predict_double(const adaboost_model* model, const double* samples, int sampleTotal,
+                            int featureTotal, long long stride, double* scores)
+{
+    return predictDense(model, samples, sampleTotal, featureTotal, stride, scores);
+}
+
+int adaboost_predict_float(const adaboost_model* model, const float* samples, int sampleTotal,
+                           int featureTotal, long long stride, double* scores)
+{
+    return predictDense(model, samples, sampleTotal, featureTotal, stride, scores);
+}
+
+int adaboost_predict_sparse(const adaboost_model* model, const int* featureIndices,
+                            const double* featureValues, int elementTotal, double* score)
+{
+    if (model == NULL || elementTotal < 0 || score == NULL) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    if (elementTotal > 0 && (featureIndices == NULL || featureValues == NULL)) return ADABOOST_ERROR_INVALID_ARGUMENT;
+    
+    *score = model->adaBoost.predictSparse(featureIndices, featureValues, elementTotal);
+    return ADABOOST_OK;
+}
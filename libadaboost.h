@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2013, Koichiro Yamaguchi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// C API of the AdaBoost predictor (libadaboost)
+// A model handle is immutable once it is loaded, so it can be used by any number of threads at once.
+// Prediction doesn't allocate memory, and errors are returned as status codes.
+
+#ifndef LIBADABOOST_H
+#define LIBADABOOST_H
+
+#if defined(__GNUC__)
+#define ADABOOST_API __attribute__((visibility("default")))
+#else
+#define ADABOOST_API
+#endif
+
+// Functions are only added to the API as long as its version stays the same
+#define ADABOOST_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes
+enum {
+    ADABOOST_OK = 0,
+    ADABOOST_ERROR_INVALID_ARGUMENT = 1,
+    ADABOOST_ERROR_CANT_OPEN_FILE = 2,
+    ADABOOST_ERROR_BAD_FORMAT = 3,
+    ADABOOST_ERROR_OUT_OF_MEMORY = 4
+};
+
+typedef struct adaboost_model adaboost_model;
+
+// ADABOOST_API_VERSION of the library
+ADABOOST_API int adaboost_api_version(void);
+// Description of a status code (a static string)
+ADABOOST_API const char* adaboost_status_message(int status);
+
+// Reads a model file written by abtrain and sets *model to its handle (NULL on error)
+ADABOOST_API int adaboost_model_load(const char* filename, adaboost_model** model);
+// Releases a handle (NULL is ignored); no other thread may use it any more
+ADABOOST_API void adaboost_model_free(adaboost_model* model);
+// The number of features needed by the model (largest used feature index + 1)
+ADABOOST_API int adaboost_model_feature_dimension(const adaboost_model* model, int* featureDimension);
+
+// Scores sampleTotal samples stored row by row and writes them to scores[0, sampleTotal)
+// Feature d of sample i is samples[i*stride + d] for d < featureTotal, and features from featureTotal on
+// are 0 (stride >= featureTotal). The stumps are added in round order, so the scores of double samples are
+// exactly those of abpredict without -c; float samples are widened to double first.
+ADABOOST_API int adaboost_predict_double(const adaboost_model* model, const double* samples, int sampleTotal,
+                                         int featureTotal, long long stride, double* scores);
+ADABOOST_API int adaboost_predict_float(const adaboost_model* model, const float* samples, int sampleTotal,
+                                        int featureTotal, long long stride, double* scores);
+// Scores a sparse sample: feature featureIndices[k] has the value featureValues[k] for k < elementTotal
+// (the indices are distinct), and the others are 0. Only the features used by the model are looked up,
+// and indices which it doesn't use are ignored. The score can differ from abpredict by rounding.
+ADABOOST_API int adaboost_predict_sparse(const adaboost_model* model, const int* featureIndices,
+                                         const double* featureValues, int elementTotal, double* score);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,96 +3,476 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "MappedFile.h"
+#include "ThreadPool.h"
 
-struct FeatureElement {
-    int index;
-    double value;
+// Chunks are at least this size, so that small files aren't split into many pieces
+static const long long minChunkSize = 1 << 20;
+
+// Line-aligned part of a data file
+struct DataChunk {
+    const char* begin;
+    const char* end;
+    
+    // Counted in the first pass
+    long long firstLineNumber;
+    long long lineTotal;
+    long long sampleTotal;
+    long long elementTotal;
+    
+    // Result of the second pass
+    long long sampleBegin;
+    long long elementBegin;
+    int featureDimension;
+    long long errorLineNumber;
 };
 
-bool readLine(FILE* inputFile, char*& lineBuffer, int& maxLineLength);
+static bool isBlank(const char character) {
+    return character == ' ' || character == '\t' || character == '\r' || character == '\n'
+           || character == '\v' || character == '\f';
+}
 
-void readSampleDataFile(const std::string sampleDataFilename,
-                        std::vector< std::vector<double> >& sampleFeatures,
-                        std::vector<bool>& sampleLabels)
-{
-    FILE* dataFile;
-    dataFile = fopen(sampleDataFilename.c_str(), "r");
-    if (dataFile == NULL) {
-        std::cerr << "error: can't open file (" << sampleDataFilename << ")" << std::endl;
-        exit(1);
+static bool isDigit(const char character) {
+    return character >= '0' && character <= '9';
+}
+
+static bool isBlankLine(const char* lineBegin, const char* lineEnd) {
+    for (const char* position = lineBegin; position < lineEnd; ++position) {
+        if (!isBlank(*position)) return false;
     }
+    return true;
+}
+
+// Parses a decimal number without depending on the locale
+// Numbers which can't be converted exactly with one multiplication or division
+// (more than 19 digits, large exponent, inf, nan, hex) fall back to strtod.
+static const char* parseDouble(const char* position, const char* end, double& value) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
     
-    int maxLineLength = 1024;
-    char* lineBuffer = reinterpret_cast<char*>(malloc(maxLineLength));
+    const char* numberBegin = position;
+    bool negative = false;
+    if (position < end && (*position == '-' || *position == '+')) {
+        negative = (*position == '-');
+        ++position;
+    }
     
-    std::vector< std::vector<FeatureElement> > featureElementList;
-    std::vector<int> labelList;
+    unsigned long long mantissa = 0;
+    int mantissaDigitTotal = 0;
+    int exponent = 0;
+    bool digitFound = false;
+    bool truncated = false;
+    bool afterPoint = false;
+    while (position < end) {
+        if (*position == '.' && !afterPoint) {
+            afterPoint = true;
+            ++position;
+            continue;
+        }
+        if (!isDigit(*position)) break;
+        
+        int digit = *position - '0';
+        digitFound = true;
+        if (mantissa == 0 && digit == 0) {
+            if (afterPoint) --exponent;
+        } else if (mantissaDigitTotal < 19) {
+            mantissa = mantissa*10 + digit;
+            ++mantissaDigitTotal;
+            if (afterPoint) --exponent;
+        } else {
+            truncated = true;
+            if (!afterPoint) ++exponent;
+        }
+        ++position;
+    }
+    
+    if (digitFound && position < end && (*position == 'e' || *position == 'E')) {
+        const char* exponentPosition = position + 1;
+        bool negativeExponent = false;
+        if (exponentPosition < end && (*exponentPosition == '-' || *exponentPosition == '+')) {
+            negativeExponent = (*exponentPosition == '-');
+            ++exponentPosition;
+        }
+        if (exponentPosition < end && isDigit(*exponentPosition)) {
+            int exponentValue = 0;
+            while (exponentPosition < end && isDigit(*exponentPosition)) {
+                if (exponentValue < 100000) exponentValue = exponentValue*10 + (*exponentPosition - '0');
+                ++exponentPosition;
+            }
+            exponent += negativeExponent ? -exponentValue : exponentValue;
+            position = exponentPosition;
+        }
+    }
     
-    int featureDimension = 0;
+    if (digitFound && !truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22
+        && (position >= end || isBlank(*position)))
+    {
+        value = static_cast<double>(mantissa);
+        if (exponent < 0) value /= powersOfTen[-exponent];
+        else value *= powersOfTen[exponent];
+        if (negative) value = -value;
+        return position;
+    }
     
-    while (readLine(dataFile, lineBuffer, maxLineLength)) {
-        char* labelChar = strtok(lineBuffer, " \t");
-        char* endPointer;
-        int label = static_cast<int>(strtol(labelChar, &endPointer, 10));
-        if (endPointer == labelChar) {
-            std::cerr << "error: bad format in data file (" << sampleDataFilename << ")" << std::endl;
-            exit(1);
+    // strtod needs a terminated string
+    const char* tokenEnd = numberBegin;
+    while (tokenEnd < end && !isBlank(*tokenEnd)) ++tokenEnd;
+    std::string token(numberBegin, tokenEnd);
+    char* endPointer;
+    value = strtod(token.c_str(), &endPointer);
+    if (endPointer == token.c_str()) return NULL;
+    return numberBegin + (endPointer - token.c_str());
+}
+
+// Parses one sample line, writing its features to featureIndices/featureValues
+// Returns false if the line has bad format.
+static bool parseLine(const char* position,
+                      const char* lineEnd,
+                      signed char& label,
+                      int* featureIndices,
+                      double* featureValues,
+                      long long& elementTotal,
+                      int& featureDimension)
+{
+    while (position < lineEnd && isBlank(*position)) ++position;
+    
+    // Label (trailing characters after the integer are ignored)
+    bool negativeLabel = false;
+    if (position < lineEnd && (*position == '-' || *position == '+')) {
+        negativeLabel = (*position == '-');
+        ++position;
+    }
+    if (position >= lineEnd || !isDigit(*position)) return false;
+    bool positiveLabel = false;
+    while (position < lineEnd && isDigit(*position)) {
+        if (*position != '0') positiveLabel = true;
+        ++position;
+    }
+    label = (positiveLabel && !negativeLabel) ? 1 : -1;
+    while (position < lineEnd && !isBlank(*position)) ++position;
+    
+    elementTotal = 0;
+    while (true) {
+        while (position < lineEnd && isBlank(*position)) ++position;
+        if (position >= lineEnd) break;
+        
+        // Feature index
+        if (*position == '+') ++position;
+        if (position >= lineEnd || !isDigit(*position)) return false;
+        long long featureIndex = 0;
+        while (position < lineEnd && isDigit(*position)) {
+            featureIndex = featureIndex*10 + (*position - '0');
+            if (featureIndex > INT_MAX) return false;
+            ++position;
         }
-        labelList.push_back(label);
+        if (position >= lineEnd || *position != ':' || featureIndex <= 0) return false;
+        ++position;
+        
+        // Feature value
+        double featureValue;
+        position = parseDouble(position, lineEnd, featureValue);
+        if (position == NULL || (position < lineEnd && !isBlank(*position))) return false;
+        
+        featureIndices[elementTotal] = static_cast<int>(featureIndex - 1);
+        featureValues[elementTotal] = featureValue;
+        ++elementTotal;
+        if (featureIndex > featureDimension) featureDimension = static_cast<int>(featureIndex);
+    }
+    
+    return true;
+}
+
+// Counts lines, samples (non-blank lines) and feature elements (':') of a chunk
+static void countChunk(DataChunk& chunk) {
+    chunk.lineTotal = 0;
+    chunk.sampleTotal = 0;
+    chunk.elementTotal = 0;
+    
+    const char* lineBegin = chunk.begin;
+    while (lineBegin < chunk.end) {
+        const char* lineEnd = reinterpret_cast<const char*>(memchr(lineBegin, '\n', chunk.end - lineBegin));
+        if (lineEnd == NULL) lineEnd = chunk.end;
         
-        std::vector<FeatureElement> featureElements;
-        while (1) {
-            char* indexChar = strtok(NULL, ":");
-            char* valueChar = strtok(NULL, " \t");
-            if (valueChar == NULL) break;
-            
-            FeatureElement newElement;
-            newElement.index = static_cast<int>(strtol(indexChar, &endPointer, 10));
-            if (endPointer == indexChar || *endPointer != '\0' || newElement.index <= 0) {
-                std::cerr << "error: bad format in data file (" << sampleDataFilename << ")" << std::endl;
-                exit(1);
+        ++chunk.lineTotal;
+        if (!isBlankLine(lineBegin, lineEnd)) {
+            ++chunk.sampleTotal;
+            for (const char* position = lineBegin; position < lineEnd; ++position) {
+                if (*position == ':') ++chunk.elementTotal;
             }
-            newElement.value = strtod(valueChar, &endPointer);
-            if (endPointer == valueChar || (*endPointer != '\0' && !isspace(*endPointer))) {
-                std::cerr << "error: bad format in data file (" << sampleDataFilename << ")" << std::endl;
-                exit(1);
+        }
+        lineBegin = lineEnd + 1;
+    }
+}
+
+static void parseChunk(DataChunk& chunk,
+                       SparseSampleData& sampleFeatures,
+                       std::vector<signed char>& labels)
+{
+    chunk.featureDimension = 0;
+    chunk.errorLineNumber = -1;
+    
+    long long sampleIndex = chunk.sampleBegin;
+    long long elementIndex = chunk.elementBegin;
+    long long lineNumber = chunk.firstLineNumber;
+    const char* lineBegin = chunk.begin;
+    while (lineBegin < chunk.end) {
+        const char* lineEnd = reinterpret_cast<const char*>(memchr(lineBegin, '\n', chunk.end - lineBegin));
+        if (lineEnd == NULL) lineEnd = chunk.end;
+        
+        if (!isBlankLine(lineBegin, lineEnd)) {
+            long long elementTotal;
+            if (!parseLine(lineBegin, lineEnd, labels[sampleIndex],
+                           sampleFeatures.featureIndices.data() + elementIndex,
+                           sampleFeatures.featureValues.data() + elementIndex,
+                           elementTotal, chunk.featureDimension))
+            {
+                chunk.errorLineNumber = lineNumber;
+                return;
             }
-            featureElements.push_back(newElement);
-            
-            if (newElement.index > featureDimension) featureDimension = newElement.index;
+            elementIndex += elementTotal;
+            ++sampleIndex;
+            sampleFeatures.sampleOffsets[sampleIndex] = elementIndex;
         }
-        featureElementList.push_back(featureElements);
+        ++lineNumber;
+        lineBegin = lineEnd + 1;
     }
-    fclose(dataFile);
-    free(lineBuffer);
+}
+
+void readSampleDataFile(const std::string sampleDataFilename,
+                        std::vector< std::vector<double> >& sampleFeatures,
+                        std::vector<bool>& sampleLabels,
+                        const int threadTotal)
+{
+    SparseSampleData sparseSampleFeatures;
+    readSampleDataFile(sampleDataFilename, sparseSampleFeatures, sampleLabels, threadTotal);
     
-    int sampleTotal = static_cast<int>(featureElementList.size());
+    int sampleTotal = static_cast<int>(sampleLabels.size());
+    int featureDimension = sparseSampleFeatures.featureDimension;
     
     sampleFeatures.resize(sampleTotal);
-    sampleLabels.resize(sampleTotal);
     for (int sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
-        if (labelList[sampleIndex] > 0) sampleLabels[sampleIndex] = true;
-        else sampleLabels[sampleIndex] = false;
-
         sampleFeatures[sampleIndex].resize(featureDimension);
         for (int i = 0; i < featureDimension; ++i) sampleFeatures[sampleIndex][i] = 0;
-        for (int elementIndex = 0; elementIndex < static_cast<int>(featureElementList[sampleIndex].size()); ++elementIndex) {
-            sampleFeatures[sampleIndex][featureElementList[sampleIndex][elementIndex].index - 1]
-                = featureElementList[sampleIndex][elementIndex].value;
+        for (long long elementIndex = sparseSampleFeatures.sampleOffsets[sampleIndex];
+             elementIndex < sparseSampleFeatures.sampleOffsets[sampleIndex + 1]; ++elementIndex)
+        {
+            sampleFeatures[sampleIndex][sparseSampleFeatures.featureIndices[elementIndex]]
+                = sparseSampleFeatures.featureValues[elementIndex];
+        }
+    }
+}
+
+void readSampleDataFile(const std::string sampleDataFilename,
+                        SparseSampleData& sampleFeatures,
+                        std::vector<bool>& sampleLabels,
+                        const int threadTotal)
+{
+    // Regular files are mapped; others (pipes, FIFOs, devices) have no size and are read into a buffer
+    struct stat fileStatus;
+    if (stat(sampleDataFilename.c_str(), &fileStatus) != 0) {
+        std::cerr << "error: can't open file (" << sampleDataFilename << ")" << std::endl;
+        exit(1);
+    }
+    MappedFile dataFile;
+    std::vector<char> dataBuffer;
+    const char* fileData;
+    long long fileSize;
+    if (S_ISREG(fileStatus.st_mode)) {
+        if (!dataFile.open(sampleDataFilename)) {
+            std::cerr << "error: can't open file (" << sampleDataFilename << ")" << std::endl;
+            exit(1);
+        }
+        fileData = dataFile.data();
+        fileSize = dataFile.size();
+        dataFile.adviseSequential(0, fileSize);
+    } else {
+        FILE* inputFile = fopen(sampleDataFilename.c_str(), "rb");
+        if (inputFile == NULL) {
+            std::cerr << "error: can't open file (" << sampleDataFilename << ")" << std::endl;
+            exit(1);
+        }
+        const size_t readBlockSize = 1 << 20;
+        while (true) {
+            size_t readOffset = dataBuffer.size();
+            dataBuffer.resize(readOffset + readBlockSize);
+            size_t readSize = fread(&dataBuffer[readOffset], 1, readBlockSize, inputFile);
+            dataBuffer.resize(readOffset + readSize);
+            if (readSize == 0) break;
+        }
+        bool readFailed = ferror(inputFile) != 0;
+        fclose(inputFile);
+        if (readFailed) {
+            std::cerr << "error: can't read file (" << sampleDataFilename << ")" << std::endl;
+            exit(1);
+        }
+        fileData = dataBuffer.data();
+        fileSize = static_cast<long long>(dataBuffer.size());
+    }
+    
+    // Split into chunks which begin at the start of a line
+    long long chunkTotal = fileSize/minChunkSize;
+    if (chunkTotal > 4LL*threadTotal) chunkTotal = 4LL*threadTotal;
+    if (chunkTotal < 1) chunkTotal = 1;
+    std::vector<DataChunk> chunks;
+    const char* chunkBegin = fileData;
+    for (long long chunkIndex = 0; chunkIndex < chunkTotal && chunkBegin < fileData + fileSize; ++chunkIndex) {
+        const char* chunkEnd = fileData + fileSize*(chunkIndex + 1)/chunkTotal;
+        if (chunkEnd < chunkBegin) chunkEnd = chunkBegin;
+        if (chunkEnd < fileData + fileSize) {
+            const char* newlinePosition = reinterpret_cast<const char*>(memchr(chunkEnd, '\n', fileData + fileSize - chunkEnd));
+            if (newlinePosition == NULL) chunkEnd = fileData + fileSize;
+            else chunkEnd = newlinePosition + 1;
+        }
+        
+        DataChunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        chunkBegin = chunkEnd;
+    }
+    
+    ThreadPool threadPool(threadTotal);
+    threadPool.run(static_cast<int>(chunks.size()), [&](const int chunkIndex, const int) {
+        countChunk(chunks[chunkIndex]);
+    });
+    
+    long long lineNumber = 1;
+    long long sampleTotal = 0;
+    long long elementTotal = 0;
+    for (int chunkIndex = 0; chunkIndex < static_cast<int>(chunks.size()); ++chunkIndex) {
+        chunks[chunkIndex].firstLineNumber = lineNumber;
+        chunks[chunkIndex].sampleBegin = sampleTotal;
+        chunks[chunkIndex].elementBegin = elementTotal;
+        lineNumber += chunks[chunkIndex].lineTotal;
+        sampleTotal += chunks[chunkIndex].sampleTotal;
+        elementTotal += chunks[chunkIndex].elementTotal;
+    }
+    if (sampleTotal > INT_MAX) {
+        std::cerr << "error: too many samples in data file (" << sampleDataFilename << ")" << std::endl;
+        exit(1);
+    }
+    
+    // Samples are parsed directly into their final place
+    std::vector<signed char> labels(sampleTotal);
+    sampleFeatures.sampleOffsets.resize(sampleTotal + 1);
+    sampleFeatures.sampleOffsets[0] = 0;
+    sampleFeatures.featureIndices.resize(elementTotal);
+    sampleFeatures.featureValues.resize(elementTotal);
+    threadPool.run(static_cast<int>(chunks.size()), [&](const int chunkIndex, const int) {
+        parseChunk(chunks[chunkIndex], sampleFeatures, labels);
+    });
+    
+    dataFile.close();
+    
+    sampleFeatures.featureDimension = 0;
+    for (int chunkIndex = 0; chunkIndex < static_cast<int>(chunks.size()); ++chunkIndex) {
+        if (chunks[chunkIndex].errorLineNumber >= 0) {
+            std::cerr << "error: bad format in data file (" << sampleDataFilename;
+            std::cerr << ", line " << chunks[chunkIndex].errorLineNumber << ")" << std::endl;
+            exit(1);
+        }
+        if (chunks[chunkIndex].featureDimension > sampleFeatures.featureDimension) {
+            sampleFeatures.featureDimension = chunks[chunkIndex].featureDimension;
+        }
+    }
+    
+    sampleLabels.resize(sampleTotal);
+    for (long long sampleIndex = 0; sampleIndex < sampleTotal; ++sampleIndex) {
+        sampleLabels[sampleIndex] = (labels[sampleIndex] > 0);
+    }
+}
+
+
+SampleDataStream::SampleDataStream(const std::string& sampleDataFilename, const long long blockSize)
+    : filename_(sampleDataFilename), dataFile_(NULL), blockSize_(blockSize), nextLineNumber_(1)
+{
+    if (sampleDataFilename == "-") {
+        dataFile_ = stdin;
+    } else {
+        dataFile_ = fopen(sampleDataFilename.c_str(), "rb");
+        if (dataFile_ == NULL) {
+            std::cerr << "error: can't open file (" << sampleDataFilename << ")" << std::endl;
+            exit(1);
         }
     }
 }
 
+SampleDataStream::~SampleDataStream() {
+    if (dataFile_ != NULL && dataFile_ != stdin) fclose(dataFile_);
+}
 
-bool readLine(FILE* inputFile, char*& lineBuffer, int& maxLineLength) {
-    if (fgets(lineBuffer, maxLineLength, inputFile) == NULL) return false;
+bool SampleDataStream::readBlock(SampleDataBlock& block) {
+    block.data.swap(remainder_);
+    remainder_.clear();
+    block.firstLineNumber = nextLineNumber_;
+    
+    // Read until the block has a line end (a single line may be longer than blockSize)
+    while (true) {
+        size_t readOffset = block.data.size();
+        block.data.resize(readOffset + blockSize_);
+        size_t readSize = fread(&block.data[readOffset], 1, blockSize_, dataFile_);
+        block.data.resize(readOffset + readSize);
+        if (readSize == 0) break;
+        
+        const char* blockBegin = &block.data[0];
+        const char* lineEnd = NULL;
+        for (const char* position = blockBegin + block.data.size(); position > blockBegin + readOffset; --position) {
+            if (position[-1] == '\n') {
+                lineEnd = position;
+                break;
+            }
+        }
+        if (lineEnd != NULL) {
+            remainder_.assign(lineEnd, blockBegin + block.data.size());
+            block.data.resize(lineEnd - blockBegin);
+            break;
+        }
+    }
+    if (ferror(dataFile_)) {
+        std::cerr << "error: can't read file (" << filename_ << ")" << std::endl;
+        exit(1);
+    }
+    if (block.data.empty()) return false;
     
-    while (strrchr(lineBuffer, '\n') == NULL) {
-        maxLineLength *= 2;
-        lineBuffer = reinterpret_cast<char*>(realloc(lineBuffer, maxLineLength));
-        int readLength = static_cast<int>(strlen(lineBuffer));
-        if (fgets(lineBuffer+readLength, maxLineLength-readLength, inputFile) == NULL) break;
+    for (size_t position = 0; position < block.data.size(); ++position) {
+        if (block.data[position] == '\n') ++nextLineNumber_;
     }
     
     return true;
 }
+
+void parseSampleDataBlock(const SampleDataBlock& block,
+                          const std::string& sampleDataFilename,
+                          SparseSampleData& sampleFeatures,
+                          std::vector<bool>& sampleLabels)
+{
+    DataChunk chunk;
+    chunk.begin = block.data.empty() ? NULL : &block.data[0];
+    chunk.end = chunk.begin + block.data.size();
+    chunk.firstLineNumber = block.firstLineNumber;
+    chunk.sampleBegin = 0;
+    chunk.elementBegin = 0;
+    countChunk(chunk);
+    
+    std::vector<signed char> labels(chunk.sampleTotal);
+    sampleFeatures.sampleOffsets.resize(chunk.sampleTotal + 1);
+    sampleFeatures.sampleOffsets[0] = 0;
+    sampleFeatures.featureIndices.resize(chunk.elementTotal);
+    sampleFeatures.featureValues.resize(chunk.elementTotal);
+    parseChunk(chunk, sampleFeatures, labels);
+    if (chunk.errorLineNumber >= 0) {
+        std::cerr << "error: bad format in data file (" << sampleDataFilename;
+        std::cerr << ", line " << chunk.errorLineNumber << ")" << std::endl;
+        exit(1);
+    }
+    sampleFeatures.featureDimension = chunk.featureDimension;
+    
+    sampleLabels.resize(chunk.sampleTotal);
+    for (long long sampleIndex = 0; sampleIndex < chunk.sampleTotal; ++sampleIndex) {
+        sampleLabels[sampleIndex] = (labels[sampleIndex] > 0);
+    }
+}
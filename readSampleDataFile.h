@@ -1,6 +1,63 @@
+#ifndef READSAMPLEDATAFILE_H
+#define READSAMPLEDATAFILE_H
+
 #include <string>
 #include <vector>
+#include <stdio.h>
+
+// Samples in compressed sparse row format
+// Features of sample i are featureIndices/featureValues[sampleOffsets[i], sampleOffsets[i+1]),
+// feature indices start from 0.
+struct SparseSampleData {
+    int featureDimension;
+    std::vector<long long> sampleOffsets;
+    std::vector<int> featureIndices;
+    std::vector<double> featureValues;
+};
 
+// The file is memory-mapped and parsed by threadTotal threads in line-aligned chunks
 void readSampleDataFile(const std::string sampleDataFilename,
                         std::vector< std::vector<double> >& sampleFeatures,
-                        std::vector<bool>& sampleLabels);
+                        std::vector<bool>& sampleLabels,
+                        const int threadTotal = 1);
+void readSampleDataFile(const std::string sampleDataFilename,
+                        SparseSampleData& sampleFeatures,
+                        std::vector<bool>& sampleLabels,
+                        const int threadTotal = 1);
+
+// Complete lines of a data file
+struct SampleDataBlock {
+    std::vector<char> data;
+    long long firstLineNumber;
+};
+
+// Reads a data file block by block, so that memory use doesn't depend on the file size
+// The filename "-" reads the standard input.
+class SampleDataStream {
+public:
+    explicit SampleDataStream(const std::string& sampleDataFilename, const long long blockSize = 1 << 24);
+    ~SampleDataStream();
+    
+    const std::string& filename() const { return filename_; }
+    
+    // Reads the next block of about blockSize bytes, ending at the end of a line
+    // Returns false at the end of the input.
+    bool readBlock(SampleDataBlock& block);
+    
+private:
+    SampleDataStream(const SampleDataStream&);
+    SampleDataStream& operator=(const SampleDataStream&);
+    
+    std::string filename_;
+    FILE* dataFile_;
+    long long blockSize_;
+    std::vector<char> remainder_;
+    long long nextLineNumber_;
+};
+
+void parseSampleDataBlock(const SampleDataBlock& block,
+                          const std::string& sampleDataFilename,
+                          SparseSampleData& sampleFeatures,
+                          std::vector<bool>& sampleLabels);
+
+#endif